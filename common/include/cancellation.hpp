@@ -0,0 +1,63 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+
+class CancellationRegistration;
+
+// Single-threaded cancellation: cancel() must be called from the thread that
+// runs the loop the cancelled operations are waiting on. The source must
+// outlive every token and registration created from it.
+class CancellationSource {
+public:
+  CancellationSource() = default;
+  CancellationSource(const CancellationSource &) = delete;
+  auto operator=(const CancellationSource &) -> CancellationSource & = delete;
+  ~CancellationSource();
+
+  void cancel();
+  [[nodiscard]] bool cancelled() const { return cancelled_; }
+
+private:
+  friend class CancellationRegistration;
+
+  bool cancelled_{false};
+  CancellationRegistration *head_{nullptr};
+};
+
+class CancellationToken {
+public:
+  CancellationToken() = default;
+  CancellationToken(CancellationSource &source) : source_{&source} {}
+
+  [[nodiscard]] bool cancelled() const {
+    return source_ != nullptr && source_->cancelled();
+  }
+
+private:
+  friend class CancellationRegistration;
+
+  CancellationSource *source_{nullptr};
+};
+
+// Intrusive list node linking a callback to a source, so registering does not
+// allocate. The callback runs at most once and is unlinked before it runs.
+class CancellationRegistration {
+public:
+  CancellationRegistration() = default;
+  CancellationRegistration(const CancellationRegistration &) = delete;
+  auto operator=(const CancellationRegistration &)
+      -> CancellationRegistration & = delete;
+  ~CancellationRegistration() { reset(); }
+
+  void attach(CancellationToken token, std::function<void()> callback);
+  void reset();
+
+private:
+  friend class CancellationSource;
+
+  CancellationSource *source_{nullptr};
+  CancellationRegistration *previous_{nullptr};
+  CancellationRegistration *next_{nullptr};
+  std::function<void()> callback_;
+};
@@ -1,28 +1,164 @@
+#pragma once
+
+#include "cancellation.hpp"
+#include "frame_pool.hpp"
+
 #include <any>
+#include <array>
+#include <chrono>
+#include <coroutine>
 #include <cstdint>
 #include <fcntl.h>
 #include <functional>
+#include <optional>
+#include <span>
 #include <sys/epoll.h>
 #include <system_error>
 #include <unordered_map>
 #include <vector>
 
 using Handler = std::function<void(uint32_t)>;
+using Callback = std::function<void()>;
 
 std::error_code set_nonblocking(int fd);
 
 class EventLoop {
 public:
+  using Clock = std::chrono::steady_clock;
+
+  // Intrusive timer: the loop keeps a pointer to it while it is scheduled, so
+  // it must not move until it fires or is cancelled. Destroying a scheduled
+  // timer cancels it.
+  class Timer {
+  public:
+    Clock::time_point deadline;
+    Callback callback;
+
+    Timer() = default;
+    Timer(const Timer &) = delete;
+    auto operator=(const Timer &) -> Timer & = delete;
+    ~Timer();
+    [[nodiscard]] bool scheduled() const { return loop_ != nullptr; }
+
+  private:
+    friend class EventLoop;
+
+    EventLoop *loop_{nullptr};
+    std::size_t slot_{};
+  };
+
+  // Resumes the awaiting coroutine once fd reports one of the requested
+  // events. The first await registers the fd with the loop for good, and each
+  // fd holds one reader and one writer at a time; a second await in the same
+  // direction fails with errc::device_or_resource_busy. The fd must not also
+  // be registered with add(), and must be remove()d before it is closed.
+  class IoAwaiter {
+  public:
+    IoAwaiter(EventLoop &loop, int fd, uint32_t events,
+              CancellationToken token)
+        : loop_{loop}, fd_{fd}, events_{events}, token_{token} {}
+    IoAwaiter(const IoAwaiter &) = delete;
+    auto operator=(const IoAwaiter &) -> IoAwaiter & = delete;
+
+    bool await_ready() const { return token_.cancelled(); }
+    bool await_suspend(std::coroutine_handle<> handle);
+    std::error_code await_resume() const;
+
+  private:
+    friend class EventLoop;
+
+    [[nodiscard]] std::size_t direction() const {
+      return (events_ & EPOLLOUT) != 0 ? 1 : 0;
+    }
+
+    EventLoop &loop_;
+    int fd_;
+    uint32_t events_;
+    CancellationToken token_;
+    CancellationRegistration cancellation_;
+    std::coroutine_handle<> handle_;
+    std::error_code error_;
+  };
+
+  class SleepAwaiter {
+  public:
+    SleepAwaiter(EventLoop &loop, Clock::duration duration,
+                 CancellationToken token)
+        : loop_{loop}, duration_{duration}, token_{token} {}
+    SleepAwaiter(const SleepAwaiter &) = delete;
+    auto operator=(const SleepAwaiter &) -> SleepAwaiter & = delete;
+
+    bool await_ready() const { return token_.cancelled(); }
+    void await_suspend(std::coroutine_handle<> handle);
+    std::error_code await_resume() const;
+
+  private:
+    EventLoop &loop_;
+    Clock::duration duration_;
+    CancellationToken token_;
+    CancellationRegistration cancellation_;
+    Timer timer_;
+    std::coroutine_handle<> handle_;
+    bool cancelled_{false};
+  };
+
+  EventLoop() = default;
+  EventLoop(const EventLoop &) = delete;
+  auto operator=(const EventLoop &) -> EventLoop & = delete;
+  ~EventLoop();
+
   auto start() -> std::error_code;
+  void stop() { running_ = false; }
   std::error_code add(int fd, uint32_t events, Handler handler);
   std::error_code remove(int fd);
   std::error_code modify(int fd, uint32_t events) const;
+  void post(Callback callback);
+  void schedule(Timer &timer);
+  void cancel(Timer &timer);
   int fd() const { return fd_; };
+  FramePool &frame_pool() { return frame_pool_; }
+
+  IoAwaiter readable(int fd, CancellationToken token = {}) {
+    return {*this, fd, EPOLLIN, token};
+  }
+  IoAwaiter writable(int fd, CancellationToken token = {}) {
+    return {*this, fd, EPOLLOUT, token};
+  }
+  SleepAwaiter sleep_for(Clock::duration duration,
+                         CancellationToken token = {}) {
+    return {*this, duration, token};
+  }
 
 private:
   static constexpr int max_events{1024};
 
+  // Awaiter registration of one fd. armed is the epoll interest set; a
+  // direction stays armed while its waiters keep coming back, and is only
+  // dropped when it fires with nobody waiting.
+  struct IoState {
+    std::array<IoAwaiter *, 2> waiters{};
+    uint32_t armed{};
+    bool registered{false};
+  };
+
+  std::error_code open();
+  std::error_code watch(int fd, IoState &state, uint32_t events);
+  void wake(int fd, uint32_t events);
+  auto poll_timeout() const -> std::optional<Clock::duration>;
+  int wait(std::span<epoll_event> events);
+  void expire_timers();
+  void run_posted();
+  void sift_up(std::size_t slot);
+  void sift_down(std::size_t slot);
+  void place(Timer *timer, std::size_t slot);
+
   int fd_{-1};
+  bool running_{false};
+  bool precise_wait_{true};
   std::unordered_map<int, Handler> handlers_;
-  std::vector<int> removed_fds_;
+  std::unordered_map<int, IoState> io_;
+  std::vector<Timer *> timers_;
+  std::vector<Callback> posted_;
+  std::vector<Callback> running_posted_;
+  FramePool frame_pool_;
 };
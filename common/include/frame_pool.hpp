@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// Recycles coroutine frames in size classes so a loop that keeps spawning the
+// same coroutines stops hitting the global allocator once warmed up.
+class FramePool {
+public:
+  FramePool() = default;
+  FramePool(const FramePool &) = delete;
+  auto operator=(const FramePool &) -> FramePool & = delete;
+  ~FramePool();
+
+  void *allocate(std::size_t size);
+  void deallocate(void *frame, std::size_t size);
+
+private:
+  static constexpr std::size_t granularity{64};
+  static constexpr std::size_t max_pooled_size{4096};
+
+  struct Block {
+    Block *next;
+  };
+
+  static std::size_t size_class(std::size_t size) {
+    return (size - 1) / granularity;
+  }
+
+  std::array<Block *, max_pooled_size / granularity> free_lists_{};
+};
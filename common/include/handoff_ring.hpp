@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <new>
+#include <span>
+#include <system_error>
+#include <vector>
+
+// Bounded multi-producer, single-consumer packet queue that lets a worker
+// pass a packet it read to the worker owning the packet's session. Packets are
+// copied into preallocated slots. The consumer watches fd() in its EventLoop;
+// producers signal it only when it may have gone idle, not per packet.
+class HandoffRing {
+public:
+  static auto create(std::size_t capacity, std::size_t mtu)
+      -> std::expected<std::unique_ptr<HandoffRing>, std::error_code>;
+  HandoffRing(const HandoffRing &) = delete;
+  auto operator=(const HandoffRing &) -> HandoffRing & = delete;
+  ~HandoffRing();
+
+  // Returns false, dropping the packet, if the ring is full or the packet
+  // does not fit a slot.
+  bool push(std::span<const std::byte> packet);
+  std::size_t drain(const std::function<void(std::span<const std::byte>)> &handle);
+  [[nodiscard]] int fd() const { return fd_; }
+
+private:
+  static constexpr std::size_t cache_line{64};
+
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    std::size_t length{};
+    std::vector<std::byte> data;
+  };
+
+  HandoffRing(std::size_t capacity, std::size_t mtu, int fd);
+
+  std::vector<Slot> slots_;
+  std::size_t mask_;
+  int fd_;
+  alignas(cache_line) std::atomic<std::size_t> head_{0};
+  alignas(cache_line) std::atomic<bool> signalled_{false};
+  alignas(cache_line) std::size_t tail_{0};
+};
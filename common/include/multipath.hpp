@@ -0,0 +1,135 @@
+#pragma once
+
+#include "address_resolver.hpp"
+#include "event_loop.hpp"
+#include "packet_capture.hpp"
+#include "udp_socket.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+using Deliver = std::function<void(std::span<const std::byte>)>;
+
+// Restores send order for packets striped across paths with different
+// delays. Out-of-order packets are copied into a fixed window of slots; a
+// gap that never fills is skipped by the owner calling skip(). Anything
+// behind the window has been delivered or given up on and is dropped. The
+// first packet received sets where delivery starts. A sender restart is
+// announced by a new epoch, whose sequence starts again at zero; late
+// packets of the epoch it replaced are dropped.
+class ReorderBuffer {
+public:
+  ReorderBuffer(std::size_t window, std::size_t mtu);
+
+  void push(uint32_t epoch, uint32_t sequence, std::span<const std::byte> data,
+            const Deliver &deliver);
+  void skip(const Deliver &deliver);
+  [[nodiscard]] bool waiting() const { return buffered_ != 0; }
+  [[nodiscard]] uint32_t next() const { return next_; }
+  [[nodiscard]] uint32_t epoch() const { return epoch_; }
+
+private:
+  struct Slot {
+    bool filled{false};
+    std::size_t length{};
+    std::vector<std::byte> data;
+  };
+
+  Slot &slot(uint32_t sequence) { return slots_[sequence % slots_.size()]; }
+  void drain(const Deliver &deliver);
+  void reset(uint32_t sequence);
+
+  std::vector<Slot> slots_;
+  bool synced_{false};
+  uint32_t epoch_{};
+  uint32_t previous_epoch_{};
+  uint32_t next_{};
+  std::size_t buffered_{};
+};
+
+struct MultipathOptions {
+  std::size_t mtu{2000};
+  std::size_t reorder_window{1024};
+  EventLoop::Clock::duration probe_interval{std::chrono::milliseconds{200}};
+  // Consecutive unanswered probes after which a path stops carrying data.
+  std::size_t probe_loss_threshold{3};
+  EventLoop::Clock::duration min_reorder_timeout{std::chrono::milliseconds{5}};
+};
+
+struct PathState {
+  Address local;
+  Address remote;
+  bool up{true};
+  EventLoop::Clock::duration srtt{std::chrono::milliseconds{100}};
+  double loss{};
+  uint64_t packets_sent{};
+  uint64_t packets_received{};
+};
+
+// A peer reachable over several paths, each with its own socket bound to its
+// own local address. Data is striped across healthy paths in proportion to
+// (1 - loss) / srtt, both measured by timestamped probes on every path, and
+// delivered to the application in send order.
+class MultipathPeer {
+public:
+  MultipathPeer(EventLoop &loop, Deliver deliver, MultipathOptions options = {});
+  MultipathPeer(const MultipathPeer &) = delete;
+  auto operator=(const MultipathPeer &) -> MultipathPeer & = delete;
+  ~MultipathPeer();
+
+  auto add_path(const Address &local, const Address &remote)
+      -> std::error_code;
+  void start();
+  void capture(PacketCapture *capture);
+  [[nodiscard]] auto send(std::span<const std::byte> data) -> std::error_code;
+  [[nodiscard]] std::size_t path_count() const { return paths_.size(); }
+  [[nodiscard]] auto path(std::size_t index) const -> const PathState & {
+    return paths_[index].state;
+  }
+
+private:
+  enum class Type : uint8_t { data, probe, probe_ack };
+
+  struct Path {
+    UdpSocket socket;
+    PathState state;
+    bool measured{false};
+    uint32_t probe_sequence{};
+    bool probe_pending{false};
+    std::size_t probes_lost{};
+    double credit{};
+  };
+
+  // type, 24-bit epoch, 32-bit sequence, all big-endian.
+  static constexpr std::size_t header_size{8};
+  static constexpr uint32_t epoch_mask{0xffffff};
+  static constexpr double loss_gain{0.125};
+
+  void handle_readable(std::size_t index);
+  void handle_probe_ack(Path &path, uint32_t sequence,
+                        std::span<const std::byte> payload);
+  void send_probes();
+  void arm_reorder_timer();
+  auto select_path() -> Path *;
+  auto write(Path &path, Type type, uint32_t sequence,
+             std::span<const std::byte> payload) -> std::error_code;
+
+  EventLoop &loop_;
+  Deliver deliver_;
+  MultipathOptions options_;
+  std::vector<Path> paths_;
+  std::vector<std::byte> send_buffer_;
+  uint32_t epoch_;
+  uint32_t next_sequence_{};
+  ReorderBuffer reorder_;
+  EventLoop::Timer probe_timer_;
+  EventLoop::Timer reorder_timer_;
+  // The sequence the reorder timer is waiting on.
+  uint32_t reorder_gap_{};
+  PacketCapture *capture_{nullptr};
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+enum class CaptureInterface : uint32_t { tun = 0, udp = 1 };
+enum class CaptureDirection : uint32_t { inbound = 1, outbound = 2 };
+
+struct CapturedPacket {
+  CaptureInterface interface;
+  CaptureDirection direction;
+  std::chrono::nanoseconds timestamp;
+  std::vector<std::byte> data;
+};
+
+// Records packets into a memory-mapped pcapng file laid out as a ring of
+// fixed-size Enhanced Packet Blocks, so recording is a memcpy with no syscall.
+// Slots not yet recorded into are blocks that readers skip, so the file
+// parses as pcapng at any time: while recording, or left behind by a crashed
+// process. A clean close drops the unused slots. Once the ring wraps, the
+// oldest packets are overwritten and the file is no longer in timestamp
+// order; load() sorts it. Interface 0 carries raw IP packets from the TUN
+// side, interface 1 the UDP payloads exchanged with peers. Not thread-safe:
+// use one capture per worker.
+class PacketCapture {
+public:
+  static auto create(const std::string &path, std::size_t slots,
+                     std::size_t snaplen = default_snaplen)
+      -> std::expected<PacketCapture, std::error_code>;
+  static auto load(const std::string &path)
+      -> std::expected<std::vector<CapturedPacket>, std::error_code>;
+
+  PacketCapture(PacketCapture &&capture) noexcept
+      : fd_{std::exchange(capture.fd_, -1)},
+        mapping_{std::exchange(capture.mapping_, nullptr)},
+        slots_{capture.slots_}, snaplen_{capture.snaplen_},
+        slot_size_{capture.slot_size_}, next_{capture.next_} {}
+  PacketCapture(const PacketCapture &) = delete;
+  auto operator=(const PacketCapture &) -> PacketCapture & = delete;
+  ~PacketCapture();
+
+  void record(CaptureInterface interface, CaptureDirection direction,
+              std::span<const std::byte> packet);
+  [[nodiscard]] uint64_t recorded() const { return next_; }
+
+private:
+  static constexpr std::size_t default_snaplen{2000};
+
+  PacketCapture(int fd, std::byte *mapping, std::size_t slots,
+                std::size_t snaplen, std::size_t slot_size)
+      : fd_{fd}, mapping_{mapping}, slots_{slots}, snaplen_{snaplen},
+        slot_size_{slot_size} {}
+
+  int fd_{-1};
+  std::byte *mapping_{nullptr};
+  std::size_t slots_{};
+  std::size_t snaplen_{};
+  std::size_t slot_size_{};
+  uint64_t next_{};
+};
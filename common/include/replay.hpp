@@ -0,0 +1,146 @@
+#pragma once
+
+#include "address_resolver.hpp"
+#include "event_loop.hpp"
+#include "packet_capture.hpp"
+#include "task.hpp"
+#include "tun_device.hpp"
+#include "udp_socket.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Log-linear buckets of 8 per power of two, so recording never allocates and
+// a percentile is within 12.5% of the true value.
+class LatencyHistogram {
+public:
+  void record(std::chrono::nanoseconds latency);
+  [[nodiscard]] uint64_t count() const { return count_; }
+  [[nodiscard]] auto min() const -> std::chrono::nanoseconds;
+  [[nodiscard]] auto max() const -> std::chrono::nanoseconds {
+    return std::chrono::nanoseconds{max_};
+  }
+  [[nodiscard]] auto mean() const -> std::chrono::nanoseconds;
+  [[nodiscard]] auto percentile(double fraction) const
+      -> std::chrono::nanoseconds;
+
+private:
+  static constexpr unsigned sub_bucket_bits{4};
+  static constexpr uint64_t linear_limit{uint64_t{1} << sub_bucket_bits};
+  static constexpr uint64_t sub_buckets{linear_limit / 2};
+  static constexpr std::size_t bucket_count{
+      linear_limit + (64 - sub_bucket_bits) * sub_buckets};
+
+  static std::size_t bucket(uint64_t value);
+  static uint64_t upper_bound(std::size_t bucket);
+
+  std::array<uint64_t, bucket_count> buckets_{};
+  uint64_t count_{};
+  uint64_t total_{};
+  uint64_t min_{UINT64_MAX};
+  uint64_t max_{};
+};
+
+struct ReplayStage {
+  std::string name;
+  LatencyHistogram latency;
+};
+
+struct ReplayOptions {
+  // Keep the captured inter-packet gaps; otherwise inject as fast as the
+  // data plane drains, yielding to it every batch packets.
+  bool original_rate{true};
+  std::size_t batch{32};
+  // At the original rate, gaps are slept to within this of the due time and
+  // spun for the rest, since a sleeping loop wakes up to the thread's timer
+  // slack (50us by default) late. The data plane does not run while the
+  // driver spins.
+  EventLoop::Clock::duration spin{std::chrono::microseconds{60}};
+  // How long to keep counting egress after the last packet is injected.
+  EventLoop::Clock::duration drain{std::chrono::milliseconds{50}};
+};
+
+// Feeds the inbound packets of a capture into a data plane running on the
+// same loop. TUN-side packets arrive on tun(), a socket-pair stand-in for the
+// real device, and UDP-side packets come from a loopback socket bound with
+// bind_udp(), so no privileges are needed. Whatever the data plane emits on
+// either side is counted as egress. The data plane reports its own stages
+// through add_stage() and record(); time spent injecting is stage 0.
+class ReplayDriver {
+public:
+  static constexpr std::size_t inject_stage{0};
+
+  static auto create(EventLoop &loop, std::vector<CapturedPacket> packets,
+                     ReplayOptions options = {})
+      -> std::expected<std::unique_ptr<ReplayDriver>, std::error_code>;
+  ReplayDriver(const ReplayDriver &) = delete;
+  auto operator=(const ReplayDriver &) -> ReplayDriver & = delete;
+  ~ReplayDriver();
+
+  TunDevice &tun() { return tun_; }
+  auto bind_udp(const Address &local, const Address &target)
+      -> std::error_code;
+  auto add_stage(std::string name) -> std::size_t;
+  void record(std::size_t stage, EventLoop::Clock::duration latency) {
+    stages_[stage].latency.record(latency);
+  }
+  Task<std::error_code> run();
+
+  [[nodiscard]] uint64_t injected() const { return injected_; }
+  [[nodiscard]] uint64_t skipped() const { return skipped_; }
+  [[nodiscard]] uint64_t egress(CaptureInterface interface) const {
+    return egress_[static_cast<std::size_t>(interface)];
+  }
+  [[nodiscard]] auto elapsed() const -> EventLoop::Clock::duration;
+  [[nodiscard]] double packets_per_second() const;
+  [[nodiscard]] auto stages() const -> const std::vector<ReplayStage> & {
+    return stages_;
+  }
+
+private:
+  ReplayDriver(EventLoop &loop, std::vector<CapturedPacket> packets,
+               ReplayOptions options, TunDevice tun, TunDevice feed);
+  auto inject(const CapturedPacket &packet) -> std::error_code;
+  void drain_tun();
+  void drain_udp();
+
+  EventLoop &loop_;
+  std::vector<CapturedPacket> packets_;
+  ReplayOptions options_;
+  TunDevice tun_;
+  TunDevice feed_;
+  UdpSocket injector_;
+  Address target_;
+  bool udp_bound_{false};
+  std::vector<ReplayStage> stages_;
+  uint64_t injected_{};
+  uint64_t skipped_{};
+  std::array<uint64_t, 2> egress_{};
+  EventLoop::Clock::time_point started_;
+  EventLoop::Clock::time_point finished_;
+};
+
+// Records the time from construction to destruction as one sample of a
+// driver stage.
+class ScopedStage {
+public:
+  ScopedStage(ReplayDriver &driver, std::size_t stage)
+      : driver_{driver}, stage_{stage}, start_{EventLoop::Clock::now()} {}
+  ScopedStage(const ScopedStage &) = delete;
+  auto operator=(const ScopedStage &) -> ScopedStage & = delete;
+  ~ScopedStage() {
+    driver_.record(stage_, EventLoop::Clock::now() - start_);
+  }
+
+private:
+  ReplayDriver &driver_;
+  std::size_t stage_;
+  EventLoop::Clock::time_point start_;
+};
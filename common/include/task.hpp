@@ -0,0 +1,174 @@
+#pragma once
+
+#include "event_loop.hpp"
+#include "frame_pool.hpp"
+
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Frames of coroutines whose first parameter (after the object, for member
+// functions) is an EventLoop come from that loop's FramePool; all others use
+// the global allocator. Either way the pool that owns a frame is stored in
+// front of it so it can be returned on destruction.
+class TaskPromiseBase {
+public:
+  static void *operator new(std::size_t size) { return allocate(size, nullptr); }
+
+  template <typename... Args>
+  static void *operator new(std::size_t size, EventLoop &loop,
+                            Args &.../*args*/) {
+    return allocate(size, &loop.frame_pool());
+  }
+
+  template <typename Self, typename... Args>
+    requires(!std::same_as<std::remove_cvref_t<Self>, EventLoop>)
+  static void *operator new(std::size_t size, Self & /*self*/, EventLoop &loop,
+                            Args &.../*args*/) {
+    return allocate(size, &loop.frame_pool());
+  }
+
+  static void operator delete(void *frame, std::size_t size) {
+    auto *header{static_cast<std::byte *>(frame) - header_size};
+    FramePool *pool{*reinterpret_cast<FramePool **>(header)};
+    if (pool == nullptr) {
+      ::operator delete(header);
+      return;
+    }
+
+    pool->deallocate(header, size + header_size);
+  }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      TaskPromiseBase &promise{handle.promise()};
+      if (promise.detached_) {
+        handle.destroy();
+        return std::noop_coroutine();
+      }
+
+      return promise.continuation_;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { std::terminate(); }
+
+  std::coroutine_handle<> continuation_{std::noop_coroutine()};
+  bool detached_{false};
+
+private:
+  static constexpr std::size_t header_size{__STDCPP_DEFAULT_NEW_ALIGNMENT__};
+
+  static void *allocate(std::size_t size, FramePool *pool) {
+    auto *header{static_cast<std::byte *>(
+        pool != nullptr ? pool->allocate(size + header_size)
+                        : ::operator new(size + header_size))};
+    *reinterpret_cast<FramePool **>(header) = pool;
+    return header + header_size;
+  }
+};
+
+template <typename T> class Task;
+
+template <typename T> class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object() noexcept;
+
+  template <typename Value> void return_value(Value &&value) {
+    value_.emplace(std::forward<Value>(value));
+  }
+
+  T result() { return std::move(*value_); }
+
+private:
+  std::optional<T> value_;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+  void result() noexcept {}
+};
+
+// Lazily started coroutine. Awaiting a task starts it and resumes the awaiter
+// through symmetric transfer when it finishes; spawn() runs one detached on a
+// loop instead.
+template <typename T = void> class [[nodiscard]] Task {
+public:
+  using promise_type = TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit Task(Handle handle) : handle_{handle} {}
+  Task(Task &&task) noexcept : handle_{std::exchange(task.handle_, {})} {}
+  auto operator=(Task &&task) noexcept -> Task & {
+    if (this != &task) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(task.handle_, {});
+    }
+
+    return *this;
+  }
+  Task(const Task &) = delete;
+  auto operator=(const Task &) -> Task & = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      Handle handle;
+
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle.promise().continuation_ = continuation;
+        return handle;
+      }
+      T await_resume() { return handle.promise().result(); }
+    };
+
+    return Awaiter{handle_};
+  }
+
+  Handle release() { return std::exchange(handle_, {}); }
+
+private:
+  Handle handle_;
+};
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>{Task<T>::Handle::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>{Task<void>::Handle::from_promise(*this)};
+}
+
+// Starts task on the next loop iteration. Its frame is freed when it finishes,
+// so it must finish before the loop is destroyed.
+inline void spawn(EventLoop &loop, Task<> task) {
+  Task<>::Handle handle{task.release()};
+  handle.promise().detached_ = true;
+  loop.post([handle] { handle.resume(); });
+}
@@ -1,7 +1,13 @@
+#pragma once
+
+#include "packet_capture.hpp"
+
+#include <array>
 #include <expected>
 #include <span>
 #include <string_view>
 #include <system_error>
+#include <utility>
 #include <vector>
 
 class TunDevice {
@@ -14,10 +20,16 @@ public:
                 std::error_code> static create_multiqueue(std::string_view name,
                                                           std::size_t size,
                                                           short flags = 0);
+  // Two connected devices backed by a socket pair instead of /dev/net/tun:
+  // each reads as packets what the other writes. Needs no privileges.
+  static std::expected<std::pair<TunDevice, TunDevice>, std::error_code>
+  create_pair();
+  void capture(PacketCapture *capture) { capture_ = capture; }
   [[nodiscard]] int fd() const { return fd_; };
 
 private:
   static constexpr std::size_t mtu_{2000};
   int fd_{};
+  PacketCapture *capture_{nullptr};
   std::array<std::byte, mtu_> buffer_{};
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "address_resolver.hpp"
+#include "tun_device.hpp"
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+// Maps inner destination addresses to the multiqueue index of the worker that
+// owns the peer behind them. offload() attaches a socket filter program as the
+// device's steering program (TUNSETSTEERINGEBPF), so the kernel queues return
+// traffic straight to the owner. If that fails, owner() answers the same
+// question in userspace so the reading worker can hand the packet off.
+//
+// Only IPv4 destinations can be steered. Other traffic, and addresses with no
+// owner, is spread across queues by destination address. At most max_peers
+// destinations can be steered at once, the same limit as the kernel map.
+//
+// owner() runs on every worker for every packet, so it takes no lock and
+// writes nothing: the table is a fixed open-addressing array read under a
+// sequence counter, and is retried in the rare case a writer changed it
+// mid-lookup. steer() and unsteer() serialize on a mutex.
+class TunSteering {
+public:
+  explicit TunSteering(std::span<const TunDevice> queues,
+                       std::size_t max_peers = default_max_peers)
+      : device_fd_{queues.empty() ? -1 : queues.front().fd()},
+        queue_count_{queues.size()}, max_peers_{max_peers},
+        slots_(std::bit_ceil(2 * max_peers)) {}
+  TunSteering(const TunSteering &) = delete;
+  auto operator=(const TunSteering &) -> TunSteering & = delete;
+  ~TunSteering();
+
+  [[nodiscard]] auto offload() -> std::error_code;
+  [[nodiscard]] bool offloaded() const { return program_fd_ != -1; }
+  auto steer(const Address &inner, std::size_t queue) -> std::error_code;
+  auto unsteer(const Address &inner) -> std::error_code;
+  [[nodiscard]] auto owner(std::span<const std::byte> packet) const
+      -> std::optional<std::size_t>;
+
+private:
+  static constexpr std::size_t default_max_peers{65536};
+
+  // A slot is empty (0) or holds the destination in the high word and the
+  // owning queue plus one in the low word.
+  static constexpr uint64_t empty{0};
+
+  [[nodiscard]] auto home(uint32_t key) const -> std::size_t;
+  [[nodiscard]] auto lookup(uint32_t key) const -> std::optional<std::size_t>;
+  void begin_write();
+  void end_write();
+
+  int device_fd_;
+  std::size_t queue_count_;
+  std::size_t max_peers_;
+  int map_fd_{-1};
+  int program_fd_{-1};
+  std::mutex mutex_;
+  std::size_t peers_{};
+  std::vector<std::atomic<uint64_t>> slots_;
+  // Odd while a writer is changing slots_.
+  std::atomic<uint64_t> version_{0};
+};
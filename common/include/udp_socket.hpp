@@ -1,4 +1,7 @@
+#pragma once
+
 #include "address_resolver.hpp"
+#include "packet_capture.hpp"
 #include <algorithm>
 #include <cstring>
 #include <expected>
@@ -29,7 +32,7 @@ public:
   UdpSocket(UdpSocket &&socket) noexcept
       : address_{socket.address_}, bound_(socket.bound_),
         fd_(std::exchange(socket.fd_, -1)), ephemeral_(socket.ephemeral_),
-        buffer_(std::move(socket.buffer_)) {}
+        buffer_(std::move(socket.buffer_)), capture_(socket.capture_) {}
   auto operator=(UdpSocket &&socket) -> UdpSocket & {
     if (this != &socket) {
       if (fd_ != -1) {
@@ -41,6 +44,7 @@ public:
       fd_ = std::exchange(socket.fd_, -1);
       ephemeral_ = socket.ephemeral_;
       buffer_ = std::move(socket.buffer_);
+      capture_ = socket.capture_;
     }
 
     return *this;
@@ -57,6 +61,7 @@ public:
   [[nodiscard]] auto write(const Message &message) -> std::error_code;
   auto address()
       -> std::expected<std::reference_wrapper<const Address>, std::error_code>;
+  void capture(PacketCapture *capture) { capture_ = capture; }
   [[nodiscard]] int fd() const { return fd_; };
 
 private:
@@ -66,4 +71,5 @@ private:
   int fd_{-1};
   bool ephemeral_{false};
   std::vector<std::byte> buffer_{default_buffer_size};
+  PacketCapture *capture_{nullptr};
 };
@@ -0,0 +1,58 @@
+#include "cancellation.hpp"
+
+#include <utility>
+
+CancellationSource::~CancellationSource() {
+  while (head_ != nullptr) {
+    head_->reset();
+  }
+}
+
+void CancellationSource::cancel() {
+  if (cancelled_) {
+    return;
+  }
+
+  cancelled_ = true;
+  while (head_ != nullptr) {
+    CancellationRegistration *registration{head_};
+    std::function<void()> callback{std::move(registration->callback_)};
+    registration->reset();
+    callback();
+  }
+}
+
+void CancellationRegistration::attach(CancellationToken token,
+                                      std::function<void()> callback) {
+  reset();
+  if (token.source_ == nullptr) {
+    return;
+  }
+
+  source_ = token.source_;
+  callback_ = std::move(callback);
+  next_ = source_->head_;
+  if (next_ != nullptr) {
+    next_->previous_ = this;
+  }
+  source_->head_ = this;
+}
+
+void CancellationRegistration::reset() {
+  if (source_ == nullptr) {
+    return;
+  }
+
+  if (previous_ != nullptr) {
+    previous_->next_ = next_;
+  } else {
+    source_->head_ = next_;
+  }
+  if (next_ != nullptr) {
+    next_->previous_ = previous_;
+  }
+
+  source_ = nullptr;
+  previous_ = nullptr;
+  next_ = nullptr;
+}
@@ -1,9 +1,16 @@
 #include "event_loop.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <cstdint>
 #include <fcntl.h>
+#include <limits>
 #include <sys/epoll.h>
 #include <system_error>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
 
 std::error_code set_nonblocking(int fd) {
   unsigned int flags = fcntl(fd, F_GETFL, 0);
@@ -14,7 +21,22 @@ std::error_code set_nonblocking(int fd) {
   return {};
 }
 
-std::error_code EventLoop::start() {
+EventLoop::Timer::~Timer() {
+  if (loop_ != nullptr) {
+    loop_->cancel(*this);
+  }
+}
+
+EventLoop::~EventLoop() {
+  for (Timer *timer : timers_) {
+    timer->loop_ = nullptr;
+  }
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+std::error_code EventLoop::open() {
   if (fd_ == -1) {
     fd_ = epoll_create1(EPOLL_CLOEXEC);
   }
@@ -22,33 +44,51 @@ std::error_code EventLoop::start() {
     return {errno, std::system_category()};
   }
 
-  while (true) {
-    std::array<epoll_event, max_events> events{};
-    for (int fd : removed_fds_) {
-      handlers_.erase(fd);
-    }
-    removed_fds_.clear();
+  return {};
+}
+
+std::error_code EventLoop::start() {
+  std::error_code error{open()};
+  if (error) {
+    return error;
+  }
 
-    const int number_of_events{epoll_wait(fd_, events.data(), max_events, -1)};
+  std::array<epoll_event, max_events> events{};
+  running_ = true;
+  while (running_) {
+    const int number_of_events{wait(events)};
 
     if (number_of_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
       return {errno, std::system_category()};
     }
 
     for (size_t i{0}; i < number_of_events; ++i) {
-      const int fd = events.at(i).data.fd;
-
-      if (!handlers_.contains(fd)) {
+      auto entry{handlers_.find(events.at(i).data.fd)};
+      if (entry == handlers_.end()) {
         continue;
       }
 
-      Handler handler{handlers_.at(fd)};
+      // The handler may remove or replace itself, so run a copy.
+      Handler handler{entry->second};
       handler(events.at(i).events);
     }
+
+    expire_timers();
+    run_posted();
   }
+
+  return {};
 }
 
 std::error_code EventLoop::add(int fd, uint32_t events, Handler handler) {
+  std::error_code error{open()};
+  if (error) {
+    return error;
+  }
+
   epoll_event event{};
   event.events = events;
   event.data.fd = fd;
@@ -63,11 +103,28 @@ std::error_code EventLoop::add(int fd, uint32_t events, Handler handler) {
 }
 
 std::error_code EventLoop::remove(int fd) {
+  auto io{io_.find(fd)};
+  if (io != io_.end()) {
+    const IoState state{io->second};
+    io_.erase(io);
+    for (IoAwaiter *waiter : state.waiters) {
+      if (waiter != nullptr) {
+        waiter->cancellation_.reset();
+        waiter->error_ = std::make_error_code(std::errc::operation_canceled);
+        post([waiter] { waiter->handle_.resume(); });
+      }
+    }
+    if (!state.registered) {
+      handlers_.erase(fd);
+      return {};
+    }
+  }
+
   if (epoll_ctl(fd_, EPOLL_CTL_DEL, fd, nullptr) == -1) {
     return {errno, std::system_category()};
   }
 
-  removed_fds_.push_back(fd);
+  handlers_.erase(fd);
   return {};
 }
 
@@ -81,3 +138,286 @@ std::error_code EventLoop::modify(int fd, uint32_t events) const {
 
   return {};
 }
+
+void EventLoop::post(Callback callback) {
+  posted_.push_back(std::move(callback));
+}
+
+void EventLoop::schedule(Timer &timer) {
+  if (timer.loop_ == nullptr) {
+    timer.loop_ = this;
+    timers_.push_back(&timer);
+    timer.slot_ = timers_.size() - 1;
+  }
+
+  sift_up(timer.slot_);
+  sift_down(timer.slot_);
+}
+
+void EventLoop::cancel(Timer &timer) {
+  if (timer.loop_ != this) {
+    return;
+  }
+
+  const std::size_t slot{timer.slot_};
+  Timer *last{timers_.back()};
+  timers_.pop_back();
+  timer.loop_ = nullptr;
+  if (last != &timer) {
+    place(last, slot);
+    sift_up(slot);
+    sift_down(last->slot_);
+  }
+}
+
+// Brings the epoll registration of an awaited fd in line with events. An
+// empty set unregisters the fd, so a hung-up peer that nobody waits on does
+// not keep waking the loop.
+std::error_code EventLoop::watch(int fd, IoState &state, uint32_t events) {
+  if (events == 0) {
+    if (state.registered && epoll_ctl(fd_, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+      return {errno, std::system_category()};
+    }
+    state.registered = false;
+    state.armed = 0;
+    return {};
+  }
+
+  if (state.registered) {
+    std::error_code error{modify(fd, events)};
+    if (!error) {
+      state.armed = events;
+    }
+    if (error != std::errc::no_such_file_or_directory) {
+      return error;
+    }
+    // The fd was closed without being removed and its number reused.
+  }
+
+  std::error_code error{
+      add(fd, events, [this, fd](uint32_t ready) { wake(fd, ready); })};
+  if (error) {
+    return error;
+  }
+
+  state.registered = true;
+  state.armed = events;
+  return {};
+}
+
+// The registration is level-triggered, so a waiter that comes back without
+// draining the fd is woken again, and the steady state needs no epoll_ctl.
+void EventLoop::wake(int fd, uint32_t events) {
+  static constexpr std::array<uint32_t, 2> interest{EPOLLIN, EPOLLOUT};
+  const uint32_t failure{events & (EPOLLERR | EPOLLHUP)};
+
+  uint32_t idle{0};
+  for (std::size_t direction{0}; direction < interest.size(); ++direction) {
+    if ((events & interest[direction]) == 0 && failure == 0) {
+      continue;
+    }
+
+    // Resuming may remove the fd, so look it up again every time.
+    auto entry{io_.find(fd)};
+    if (entry == io_.end()) {
+      return;
+    }
+
+    IoAwaiter *waiter{std::exchange(entry->second.waiters[direction], nullptr)};
+    if (waiter == nullptr) {
+      idle |= interest[direction];
+      continue;
+    }
+    waiter->cancellation_.reset();
+    waiter->handle_.resume();
+  }
+
+  auto entry{io_.find(fd)};
+  if (entry == io_.end()) {
+    return;
+  }
+  IoState &state{entry->second};
+  for (std::size_t direction{0}; direction < interest.size(); ++direction) {
+    if (state.waiters[direction] != nullptr) {
+      idle &= ~interest[direction];
+    }
+  }
+  if ((state.armed & idle) != 0) {
+    std::error_code error{watch(fd, state, state.armed & ~idle)};
+  }
+}
+
+// Time until the next timer, or nothing to block until an event arrives.
+auto EventLoop::poll_timeout() const -> std::optional<Clock::duration> {
+  if (!posted_.empty() || !running_) {
+    return Clock::duration::zero();
+  }
+  if (timers_.empty()) {
+    return std::nullopt;
+  }
+
+  return std::max(timers_.front()->deadline - Clock::now(),
+                  Clock::duration::zero());
+}
+
+// epoll_pwait2 takes a nanosecond timeout, so a timer fires at its deadline
+// (plus the thread's timer slack) rather than on the next millisecond. Older
+// kernels fall back to epoll_wait.
+int EventLoop::wait(std::span<epoll_event> events) {
+  const std::optional<Clock::duration> timeout{poll_timeout()};
+  const auto size{static_cast<int>(events.size())};
+
+  if (precise_wait_) {
+    timespec wait_for{};
+    if (timeout) {
+      const auto seconds{std::chrono::floor<std::chrono::seconds>(*timeout)};
+      wait_for.tv_sec = seconds.count();
+      wait_for.tv_nsec =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(*timeout -
+                                                               seconds)
+              .count();
+    }
+
+    const int number_of_events{epoll_pwait2(
+        fd_, events.data(), size, timeout ? &wait_for : nullptr, nullptr)};
+    if (number_of_events != -1 || errno != ENOSYS) {
+      return number_of_events;
+    }
+    precise_wait_ = false;
+  }
+
+  // Round up so a timer is never woken for before its deadline.
+  const int milliseconds{
+      timeout ? static_cast<int>(std::min<std::chrono::milliseconds::rep>(
+                    std::chrono::ceil<std::chrono::milliseconds>(*timeout)
+                        .count(),
+                    std::numeric_limits<int>::max()))
+              : -1};
+  return epoll_wait(fd_, events.data(), size, milliseconds);
+}
+
+void EventLoop::expire_timers() {
+  const Clock::time_point now{Clock::now()};
+  while (!timers_.empty() && timers_.front()->deadline <= now) {
+    Timer &timer{*timers_.front()};
+    cancel(timer);
+
+    // The callback may reschedule the timer and replace its callback.
+    Callback callback{timer.callback};
+    callback();
+  }
+}
+
+void EventLoop::run_posted() {
+  running_posted_.swap(posted_);
+  for (Callback &callback : running_posted_) {
+    callback();
+  }
+  running_posted_.clear();
+}
+
+void EventLoop::sift_up(std::size_t slot) {
+  Timer *timer{timers_[slot]};
+  while (slot > 0) {
+    const std::size_t parent{(slot - 1) / 2};
+    if (timers_[parent]->deadline <= timer->deadline) {
+      break;
+    }
+    place(timers_[parent], slot);
+    slot = parent;
+  }
+  place(timer, slot);
+}
+
+void EventLoop::sift_down(std::size_t slot) {
+  Timer *timer{timers_[slot]};
+  while (true) {
+    std::size_t child{2 * slot + 1};
+    if (child >= timers_.size()) {
+      break;
+    }
+    if (child + 1 < timers_.size() &&
+        timers_[child + 1]->deadline < timers_[child]->deadline) {
+      ++child;
+    }
+    if (timer->deadline <= timers_[child]->deadline) {
+      break;
+    }
+    place(timers_[child], slot);
+    slot = child;
+  }
+  place(timer, slot);
+}
+
+void EventLoop::place(Timer *timer, std::size_t slot) {
+  timers_[slot] = timer;
+  timer->slot_ = slot;
+}
+
+bool EventLoop::IoAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  auto entry{loop_.io_.find(fd_)};
+  if (entry == loop_.io_.end()) {
+    if (loop_.handlers_.contains(fd_)) {
+      error_ = std::make_error_code(std::errc::device_or_resource_busy);
+      return false;
+    }
+    entry = loop_.io_.try_emplace(fd_).first;
+  }
+
+  IoState &state{entry->second};
+  if (state.waiters[direction()] != nullptr) {
+    error_ = std::make_error_code(std::errc::device_or_resource_busy);
+    return false;
+  }
+  if (!state.registered || (state.armed & events_) != events_) {
+    error_ = loop_.watch(fd_, state, state.armed | events_);
+    if (error_) {
+      return false;
+    }
+  }
+
+  handle_ = handle;
+  state.waiters[direction()] = this;
+  cancellation_.attach(token_, [this] {
+    auto entry{loop_.io_.find(fd_)};
+    if (entry != loop_.io_.end() &&
+        entry->second.waiters[direction()] == this) {
+      entry->second.waiters[direction()] = nullptr;
+    }
+    error_ = std::make_error_code(std::errc::operation_canceled);
+    loop_.post([this] { handle_.resume(); });
+  });
+  return true;
+}
+
+std::error_code EventLoop::IoAwaiter::await_resume() const {
+  if (token_.cancelled() && !error_) {
+    return std::make_error_code(std::errc::operation_canceled);
+  }
+
+  return error_;
+}
+
+void EventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  timer_.deadline = Clock::now() + duration_;
+  timer_.callback = [this] {
+    cancellation_.reset();
+    handle_.resume();
+  };
+  loop_.schedule(timer_);
+
+  cancellation_.attach(token_, [this] {
+    loop_.cancel(timer_);
+    cancelled_ = true;
+    loop_.post([this] { handle_.resume(); });
+  });
+}
+
+std::error_code EventLoop::SleepAwaiter::await_resume() const {
+  if (cancelled_ || token_.cancelled()) {
+    return std::make_error_code(std::errc::operation_canceled);
+  }
+
+  return {};
+}
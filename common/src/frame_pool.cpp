@@ -0,0 +1,35 @@
+#include "frame_pool.hpp"
+
+#include <new>
+#include <utility>
+
+FramePool::~FramePool() {
+  for (Block *&head : free_lists_) {
+    while (head != nullptr) {
+      ::operator delete(std::exchange(head, head->next));
+    }
+  }
+}
+
+void *FramePool::allocate(std::size_t size) {
+  if (size == 0 || size > max_pooled_size) {
+    return ::operator new(size);
+  }
+
+  Block *&head{free_lists_[size_class(size)]};
+  if (head == nullptr) {
+    return ::operator new((size_class(size) + 1) * granularity);
+  }
+
+  return std::exchange(head, head->next);
+}
+
+void FramePool::deallocate(void *frame, std::size_t size) {
+  if (size == 0 || size > max_pooled_size) {
+    ::operator delete(frame);
+    return;
+  }
+
+  Block *&head{free_lists_[size_class(size)]};
+  head = ::new (frame) Block{head};
+}
@@ -0,0 +1,94 @@
+#include "handoff_ring.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+auto HandoffRing::create(std::size_t capacity, std::size_t mtu)
+    -> std::expected<std::unique_ptr<HandoffRing>, std::error_code> {
+  if (capacity == 0) {
+    return std::unexpected{std::make_error_code(std::errc::invalid_argument)};
+  }
+
+  int fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+  if (fd == -1) {
+    return std::unexpected{std::error_code{errno, std::system_category()}};
+  }
+
+  return std::unique_ptr<HandoffRing>{
+      new HandoffRing{std::bit_ceil(capacity), mtu, fd}};
+}
+
+HandoffRing::HandoffRing(std::size_t capacity, std::size_t mtu, int fd)
+    : slots_(capacity), mask_{capacity - 1}, fd_{fd} {
+  for (std::size_t i{0}; i < slots_.size(); ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+    slots_[i].data.resize(mtu);
+  }
+}
+
+HandoffRing::~HandoffRing() { ::close(fd_); }
+
+// Vyukov's bounded queue: a slot's sequence says whose turn it is, so
+// producers only contend on head_ and never on the consumer.
+bool HandoffRing::push(std::span<const std::byte> packet) {
+  if (packet.size() > slots_.front().data.size()) {
+    return false;
+  }
+
+  std::size_t position{head_.load(std::memory_order_relaxed)};
+  Slot *slot{};
+  while (true) {
+    slot = &slots_[position & mask_];
+    const std::size_t sequence{slot->sequence.load(std::memory_order_acquire)};
+    const auto difference{static_cast<std::intptr_t>(sequence) -
+                          static_cast<std::intptr_t>(position)};
+    if (difference == 0) {
+      if (head_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return false;
+    } else {
+      position = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  std::ranges::copy(packet, slot->data.begin());
+  slot->length = packet.size();
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  if (!signalled_.exchange(true)) {
+    const uint64_t one{1};
+    ::write(fd_, &one, sizeof(one));
+  }
+  return true;
+}
+
+std::size_t HandoffRing::drain(
+    const std::function<void(std::span<const std::byte>)> &handle) {
+  uint64_t count{};
+  ::read(fd_, &count, sizeof(count));
+  // Cleared before draining, so a push that lands after the drain below
+  // finds it false and signals again. The exchange also acquires every slot
+  // published by a push that skipped signalling because of the old value.
+  signalled_.exchange(false);
+
+  std::size_t drained{0};
+  while (true) {
+    Slot &slot{slots_[tail_ & mask_]};
+    if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+      return drained;
+    }
+
+    handle({slot.data.data(), slot.length});
+    slot.sequence.store(tail_ + slots_.size(), std::memory_order_release);
+    ++tail_;
+    ++drained;
+  }
+}
@@ -0,0 +1,345 @@
+#include "multipath.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <random>
+#include <span>
+#include <system_error>
+#include <utility>
+
+ReorderBuffer::ReorderBuffer(std::size_t window, std::size_t mtu)
+    : slots_(window) {
+  for (Slot &slot : slots_) {
+    slot.data.resize(mtu);
+  }
+}
+
+void ReorderBuffer::push(uint32_t epoch, uint32_t sequence,
+                         std::span<const std::byte> data,
+                         const Deliver &deliver) {
+  if (!synced_) {
+    // Joining a sender that may have been running for a while: its sequence
+    // can be anywhere, so start from the first packet seen.
+    previous_epoch_ = epoch;
+    epoch_ = epoch;
+    synced_ = true;
+    reset(sequence);
+  } else if (epoch != epoch_) {
+    if (epoch == previous_epoch_) {
+      return;
+    }
+    previous_epoch_ = epoch_;
+    epoch_ = epoch;
+    reset(0);
+  }
+
+  const auto window{static_cast<int64_t>(slots_.size())};
+  auto distance{static_cast<int32_t>(sequence - next_)};
+  if (distance < 0) {
+    return;
+  }
+
+  while (distance >= window) {
+    if (buffered_ == 0) {
+      next_ = sequence - static_cast<uint32_t>(window) + 1;
+    } else {
+      skip(deliver);
+    }
+    distance = static_cast<int32_t>(sequence - next_);
+  }
+
+  if (distance == 0) {
+    ++next_;
+    deliver(data);
+    drain(deliver);
+    return;
+  }
+
+  Slot &pending{slot(sequence)};
+  if (pending.filled || data.size() > pending.data.size()) {
+    return;
+  }
+
+  std::ranges::copy(data, pending.data.begin());
+  pending.length = data.size();
+  pending.filled = true;
+  ++buffered_;
+}
+
+void ReorderBuffer::skip(const Deliver &deliver) {
+  if (buffered_ == 0) {
+    return;
+  }
+
+  while (!slot(next_).filled) {
+    ++next_;
+  }
+  drain(deliver);
+}
+
+void ReorderBuffer::drain(const Deliver &deliver) {
+  while (buffered_ != 0) {
+    Slot &pending{slot(next_)};
+    if (!pending.filled) {
+      return;
+    }
+
+    pending.filled = false;
+    --buffered_;
+    ++next_;
+    deliver({pending.data.data(), pending.length});
+  }
+}
+
+void ReorderBuffer::reset(uint32_t sequence) {
+  for (Slot &slot : slots_) {
+    slot.filled = false;
+  }
+  buffered_ = 0;
+  next_ = sequence;
+}
+
+MultipathPeer::MultipathPeer(EventLoop &loop, Deliver deliver,
+                             MultipathOptions options)
+    : loop_{loop}, deliver_{std::move(deliver)}, options_{options},
+      send_buffer_(options.mtu + header_size),
+      epoch_{std::random_device{}() & epoch_mask},
+      reorder_{options.reorder_window, options.mtu} {
+  probe_timer_.callback = [this] { send_probes(); };
+  reorder_timer_.callback = [this] {
+    reorder_.skip(deliver_);
+    arm_reorder_timer();
+  };
+}
+
+MultipathPeer::~MultipathPeer() {
+  for (Path &path : paths_) {
+    std::error_code error{loop_.remove(path.socket.fd())};
+  }
+}
+
+auto MultipathPeer::add_path(const Address &local, const Address &remote)
+    -> std::error_code {
+  Path path{.socket = UdpSocket{options_.mtu + header_size},
+            .state = {.local = local, .remote = remote}};
+  path.socket.capture(capture_);
+  std::error_code error{path.socket.bind({&local, 1})};
+  if (error) {
+    return error;
+  }
+
+  error = set_nonblocking(path.socket.fd());
+  if (error) {
+    return error;
+  }
+
+  const std::size_t index{paths_.size()};
+  error = loop_.add(path.socket.fd(), EPOLLIN,
+                    [this, index](uint32_t /*events*/) {
+                      handle_readable(index);
+                    });
+  if (error) {
+    return error;
+  }
+
+  paths_.push_back(std::move(path));
+  return {};
+}
+
+void MultipathPeer::start() { send_probes(); }
+
+void MultipathPeer::capture(PacketCapture *capture) {
+  capture_ = capture;
+  for (Path &path : paths_) {
+    path.socket.capture(capture);
+  }
+}
+
+auto MultipathPeer::send(std::span<const std::byte> data) -> std::error_code {
+  Path *path{select_path()};
+  if (path == nullptr) {
+    return std::make_error_code(std::errc::network_unreachable);
+  }
+
+  std::error_code error{write(*path, Type::data, next_sequence_, data)};
+  if (error) {
+    return error;
+  }
+
+  ++next_sequence_;
+  return {};
+}
+
+// Smooth weighted round-robin: every send credits each path with its weight
+// and picks the richest, which interleaves paths instead of bursting.
+auto MultipathPeer::select_path() -> Path * {
+  const bool any_up{std::ranges::any_of(
+      paths_, [](const Path &path) { return path.state.up; })};
+
+  Path *selected{nullptr};
+  double total{};
+  for (Path &path : paths_) {
+    if (any_up && !path.state.up) {
+      continue;
+    }
+
+    const double srtt{std::max(
+        std::chrono::duration<double>{path.state.srtt}.count(), 1e-6)};
+    const double weight{std::max(1.0 - path.state.loss, 0.01) / srtt};
+    path.credit += weight;
+    total += weight;
+    if (selected == nullptr || path.credit > selected->credit) {
+      selected = &path;
+    }
+  }
+
+  if (selected != nullptr) {
+    selected->credit -= total;
+  }
+  return selected;
+}
+
+auto MultipathPeer::write(Path &path, Type type, uint32_t sequence,
+                          std::span<const std::byte> payload)
+    -> std::error_code {
+  if (payload.size() > options_.mtu) {
+    return std::make_error_code(std::errc::message_size);
+  }
+
+  send_buffer_[0] = static_cast<std::byte>(type);
+  send_buffer_[1] = static_cast<std::byte>(epoch_ >> 16);
+  send_buffer_[2] = static_cast<std::byte>(epoch_ >> 8);
+  send_buffer_[3] = static_cast<std::byte>(epoch_);
+  const uint32_t network_sequence{htonl(sequence)};
+  std::memcpy(&send_buffer_[4], &network_sequence, sizeof(network_sequence));
+  std::ranges::copy(payload, send_buffer_.begin() + header_size);
+
+  std::error_code error{path.socket.write(
+      {.address = path.state.remote,
+       .data = {send_buffer_.data(), header_size + payload.size()}})};
+  if (error) {
+    return error;
+  }
+
+  ++path.state.packets_sent;
+  return {};
+}
+
+void MultipathPeer::handle_readable(std::size_t index) {
+  Path &path{paths_[index]};
+  while (true) {
+    auto message{path.socket.read()};
+    if (!message) {
+      return;
+    }
+    if (!(message->address == path.state.remote) ||
+        message->data.size() < header_size) {
+      continue;
+    }
+
+    ++path.state.packets_received;
+    const uint32_t epoch{std::to_integer<uint32_t>(message->data[1]) << 16 |
+                         std::to_integer<uint32_t>(message->data[2]) << 8 |
+                         std::to_integer<uint32_t>(message->data[3])};
+    uint32_t sequence{};
+    std::memcpy(&sequence, &message->data[4], sizeof(sequence));
+    sequence = ntohl(sequence);
+    const std::span<const std::byte> payload{
+        message->data.subspan(header_size)};
+
+    switch (static_cast<Type>(message->data[0])) {
+    case Type::data:
+      reorder_.push(epoch, sequence, payload, deliver_);
+      arm_reorder_timer();
+      break;
+    case Type::probe: {
+      std::error_code error{write(path, Type::probe_ack, sequence, payload)};
+      break;
+    }
+    case Type::probe_ack:
+      handle_probe_ack(path, sequence, payload);
+      break;
+    }
+  }
+}
+
+// Probes carry the sender's send time, echoed back untouched, so RTT samples
+// need no clock agreement between peers.
+void MultipathPeer::handle_probe_ack(Path &path, uint32_t sequence,
+                                     std::span<const std::byte> payload) {
+  if (!path.probe_pending || sequence != path.probe_sequence ||
+      payload.size() < sizeof(uint64_t)) {
+    return;
+  }
+
+  uint64_t sent_at{};
+  std::memcpy(&sent_at, payload.data(), sizeof(sent_at));
+  const EventLoop::Clock::time_point sent{
+      EventLoop::Clock::duration{be64toh(sent_at)}};
+  const EventLoop::Clock::duration sample{EventLoop::Clock::now() - sent};
+
+  path.probe_pending = false;
+  path.probes_lost = 0;
+  path.state.up = true;
+  path.state.loss *= 1.0 - loss_gain;
+  if (path.measured) {
+    path.state.srtt = (path.state.srtt * 7 + sample) / 8;
+  } else {
+    path.state.srtt = sample;
+    path.measured = true;
+  }
+}
+
+void MultipathPeer::send_probes() {
+  const EventLoop::Clock::time_point now{EventLoop::Clock::now()};
+  const uint64_t sent_at{
+      htobe64(static_cast<uint64_t>(now.time_since_epoch().count()))};
+
+  for (Path &path : paths_) {
+    if (path.probe_pending) {
+      path.state.loss = path.state.loss * (1.0 - loss_gain) + loss_gain;
+      if (++path.probes_lost >= options_.probe_loss_threshold) {
+        path.state.up = false;
+      }
+    }
+
+    path.probe_pending = true;
+    std::error_code error{write(path, Type::probe, ++path.probe_sequence,
+                                std::as_bytes(std::span{&sent_at, 1}))};
+  }
+
+  probe_timer_.deadline = now + options_.probe_interval;
+  loop_.schedule(probe_timer_);
+}
+
+// A gap is waited on for as long as the RTT spread between paths, which is
+// how far behind a packet sent on the slowest path can be. The wait restarts
+// whenever delivery moves on to a new gap, so the deadline always belongs to
+// the gap now blocking delivery.
+void MultipathPeer::arm_reorder_timer() {
+  if (!reorder_.waiting()) {
+    loop_.cancel(reorder_timer_);
+    return;
+  }
+  if (reorder_timer_.scheduled() && reorder_.next() == reorder_gap_) {
+    return;
+  }
+  reorder_gap_ = reorder_.next();
+
+  auto fastest{EventLoop::Clock::duration::max()};
+  auto slowest{EventLoop::Clock::duration::zero()};
+  for (const Path &path : paths_) {
+    if (path.state.up) {
+      fastest = std::min(fastest, path.state.srtt);
+      slowest = std::max(slowest, path.state.srtt);
+    }
+  }
+
+  reorder_timer_.deadline =
+      EventLoop::Clock::now() +
+      std::max(options_.min_reorder_timeout, slowest - std::min(fastest, slowest));
+  loop_.schedule(reorder_timer_);
+}
@@ -0,0 +1,281 @@
+#include "packet_capture.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+
+static constexpr uint32_t section_header_block{0x0A0D0D0A};
+static constexpr uint32_t interface_description_block{1};
+static constexpr uint32_t enhanced_packet_block{6};
+// Unused slots are "do not copy" Custom Blocks, which readers must skip,
+// under the enterprise number reserved for documentation.
+static constexpr uint32_t custom_block{0x40000BAD};
+static constexpr uint32_t documentation_enterprise{32473};
+static constexpr uint32_t byte_order_magic{0x1A2B3C4D};
+static constexpr uint16_t linktype_raw{101};
+// UDP-side packets are tunnel payloads, not IP, so they get a private type.
+static constexpr uint16_t linktype_user0{147};
+static constexpr uint16_t option_end{0};
+static constexpr uint16_t option_epb_flags{2};
+static constexpr uint16_t option_if_tsresol{9};
+static constexpr uint8_t nanosecond_resolution{9};
+
+static constexpr std::size_t section_header_size{28};
+static constexpr std::size_t interface_description_size{32};
+static constexpr std::size_t file_header_size{section_header_size +
+                                              2 * interface_description_size};
+static constexpr std::size_t packet_header_size{28};
+static constexpr std::size_t packet_trailer_size{16};
+
+static constexpr auto pad(std::size_t size) -> std::size_t {
+  return (size + 3) & ~std::size_t{3};
+}
+
+template <typename T> static void put(std::byte *at, T value) {
+  std::memcpy(at, &value, sizeof(value));
+}
+
+template <typename T> static auto get(const std::byte *at) -> T {
+  T value{};
+  std::memcpy(&value, at, sizeof(value));
+  return value;
+}
+
+static void write_interface(std::byte *at, uint16_t linktype,
+                            std::size_t snaplen) {
+  put<uint32_t>(at, interface_description_block);
+  put<uint32_t>(at + 4, interface_description_size);
+  put<uint16_t>(at + 8, linktype);
+  put<uint16_t>(at + 10, 0);
+  put<uint32_t>(at + 12, static_cast<uint32_t>(snaplen));
+  put<uint16_t>(at + 16, option_if_tsresol);
+  put<uint16_t>(at + 18, 1);
+  put<uint32_t>(at + 20, 0);
+  put<uint8_t>(at + 20, nanosecond_resolution);
+  put<uint32_t>(at + 24, option_end);
+  put<uint32_t>(at + 28, interface_description_size);
+}
+
+auto PacketCapture::create(const std::string &path, std::size_t slots,
+                           std::size_t snaplen)
+    -> std::expected<PacketCapture, std::error_code> {
+  if (slots == 0 || snaplen == 0) {
+    return std::unexpected{std::make_error_code(std::errc::invalid_argument)};
+  }
+
+  const std::size_t slot_size{packet_header_size + pad(snaplen) +
+                              packet_trailer_size};
+  const std::size_t size{file_header_size + slots * slot_size};
+
+  int fd{::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+  if (fd == -1) {
+    return std::unexpected{std::error_code{errno, std::system_category()}};
+  }
+
+  if (::ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    const int truncate_errno{errno};
+    ::close(fd);
+    return std::unexpected{
+        std::error_code{truncate_errno, std::system_category()}};
+  }
+
+  void *mapping{
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+  if (mapping == MAP_FAILED) {
+    const int mmap_errno{errno};
+    ::close(fd);
+    return std::unexpected{std::error_code{mmap_errno, std::system_category()}};
+  }
+
+  auto *header{static_cast<std::byte *>(mapping)};
+  put<uint32_t>(header, section_header_block);
+  put<uint32_t>(header + 4, section_header_size);
+  put<uint32_t>(header + 8, byte_order_magic);
+  put<uint16_t>(header + 12, 1);
+  put<uint16_t>(header + 14, 0);
+  put<int64_t>(header + 16, -1);
+  put<uint32_t>(header + 24, section_header_size);
+  write_interface(header + section_header_size, linktype_raw, snaplen);
+  write_interface(header + section_header_size + interface_description_size,
+                  linktype_user0, snaplen);
+  for (std::size_t index{0}; index < slots; ++index) {
+    std::byte *slot{header + file_header_size + index * slot_size};
+    put<uint32_t>(slot, custom_block);
+    put<uint32_t>(slot + 4, static_cast<uint32_t>(slot_size));
+    put<uint32_t>(slot + 8, documentation_enterprise);
+    put<uint32_t>(slot + slot_size - 4, static_cast<uint32_t>(slot_size));
+  }
+
+  return PacketCapture{fd, header, slots, snaplen, slot_size};
+}
+
+PacketCapture::~PacketCapture() {
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, file_header_size + slots_ * slot_size_);
+  }
+  if (fd_ != -1) {
+    // Drop the slots never written so an unwrapped capture ends cleanly.
+    if (next_ < slots_) {
+      ::ftruncate(fd_,
+                  static_cast<off_t>(file_header_size + next_ * slot_size_));
+    }
+    ::close(fd_);
+  }
+}
+
+// Every slot is a complete block of the same length: the packet is followed
+// by its direction option and an end-of-options marker, and any space left
+// before the trailing length is ignored by readers. The slot is turned back
+// into a custom block while it is rewritten and only becomes a packet once
+// it is complete, so a reader copying the file mid-record, or a crash, never
+// sees a half-written packet.
+void PacketCapture::record(CaptureInterface interface,
+                           CaptureDirection direction,
+                           std::span<const std::byte> packet) {
+  const std::size_t captured{std::min(packet.size(), snaplen_)};
+  const auto timestamp{static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count())};
+
+  std::byte *slot{mapping_ + file_header_size +
+                  (next_ % slots_) * slot_size_};
+  put<uint32_t>(slot, custom_block);
+  std::atomic_thread_fence(std::memory_order_release);
+  put<uint32_t>(slot + 8, static_cast<uint32_t>(interface));
+  put<uint32_t>(slot + 12, static_cast<uint32_t>(timestamp >> 32));
+  put<uint32_t>(slot + 16, static_cast<uint32_t>(timestamp));
+  put<uint32_t>(slot + 20, static_cast<uint32_t>(captured));
+  put<uint32_t>(slot + 24, static_cast<uint32_t>(packet.size()));
+
+  std::byte *data{slot + packet_header_size};
+  std::memcpy(data, packet.data(), captured);
+  std::fill(data + captured, data + pad(captured), std::byte{0});
+
+  std::byte *options{data + pad(captured)};
+  put<uint16_t>(options, option_epb_flags);
+  put<uint16_t>(options + 2, 4);
+  put<uint32_t>(options + 4, static_cast<uint32_t>(direction));
+  put<uint32_t>(options + 8, option_end);
+  std::atomic_thread_fence(std::memory_order_release);
+  put<uint32_t>(slot, enhanced_packet_block);
+
+  ++next_;
+}
+
+static auto to_nanoseconds(uint64_t ticks, uint8_t resolution)
+    -> std::chrono::nanoseconds {
+  if ((resolution & 0x80) != 0) {
+    const uint8_t exponent{static_cast<uint8_t>(resolution & 0x7f)};
+    return std::chrono::nanoseconds{static_cast<int64_t>(
+        static_cast<long double>(ticks) * 1e9L / std::exp2l(exponent))};
+  }
+
+  uint64_t scale{1};
+  for (uint8_t i{resolution}; i < nanosecond_resolution; ++i) {
+    scale *= 10;
+  }
+  for (uint8_t i{nanosecond_resolution}; i < resolution; ++i) {
+    ticks /= 10;
+  }
+  return std::chrono::nanoseconds{static_cast<int64_t>(ticks * scale)};
+}
+
+auto PacketCapture::load(const std::string &path)
+    -> std::expected<std::vector<CapturedPacket>, std::error_code> {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    return std::unexpected{
+        std::make_error_code(std::errc::no_such_file_or_directory)};
+  }
+
+  std::vector<char> contents{std::istreambuf_iterator<char>{file},
+                             std::istreambuf_iterator<char>{}};
+  const auto *bytes{reinterpret_cast<const std::byte *>(contents.data())};
+  const std::size_t size{contents.size()};
+
+  std::vector<uint8_t> resolutions{};
+  std::vector<CapturedPacket> packets{};
+  std::size_t offset{0};
+  while (offset + 12 <= size) {
+    const std::byte *block{bytes + offset};
+    const auto type{get<uint32_t>(block)};
+    const auto length{get<uint32_t>(block + 4)};
+    // A truncated or corrupt block ends the file.
+    if (length < 12 || length % 4 != 0 || offset + length > size) {
+      break;
+    }
+
+    if (type == section_header_block) {
+      if (get<uint32_t>(block + 8) != byte_order_magic) {
+        return std::unexpected{
+            std::make_error_code(std::errc::illegal_byte_sequence)};
+      }
+      resolutions.clear();
+    } else if (type == interface_description_block && length >= 20) {
+      uint8_t resolution{6};
+      for (std::size_t option{16}; option + 4 <= length - 4;) {
+        const auto code{get<uint16_t>(block + option)};
+        const auto option_length{get<uint16_t>(block + option + 2)};
+        if (code == option_end) {
+          break;
+        }
+        if (code == option_if_tsresol && option_length >= 1) {
+          resolution = std::to_integer<uint8_t>(block[option + 4]);
+        }
+        option += 4 + pad(option_length);
+      }
+      resolutions.push_back(resolution);
+    } else if (type == enhanced_packet_block && length >= 32) {
+      const auto interface{get<uint32_t>(block + 8)};
+      const auto captured{get<uint32_t>(block + 20)};
+      if (interface >= resolutions.size() ||
+          interface > static_cast<uint32_t>(CaptureInterface::udp) ||
+          packet_header_size + pad(captured) + 4 > length) {
+        offset += length;
+        continue;
+      }
+
+      CapturedPacket packet{
+          .interface = static_cast<CaptureInterface>(interface),
+          .direction = CaptureDirection::inbound,
+          .timestamp = to_nanoseconds(
+              (static_cast<uint64_t>(get<uint32_t>(block + 12)) << 32) |
+                  get<uint32_t>(block + 16),
+              resolutions[interface]),
+          .data = {block + packet_header_size,
+                   block + packet_header_size + captured}};
+
+      for (std::size_t option{packet_header_size + pad(captured)};
+           option + 4 <= length - 4;) {
+        const auto code{get<uint16_t>(block + option)};
+        const auto option_length{get<uint16_t>(block + option + 2)};
+        if (code == option_end) {
+          break;
+        }
+        if (code == option_epb_flags && option_length == 4) {
+          const auto flags{get<uint32_t>(block + option + 4) & 3};
+          if (flags == static_cast<uint32_t>(CaptureDirection::outbound)) {
+            packet.direction = CaptureDirection::outbound;
+          }
+        }
+        option += 4 + pad(option_length);
+      }
+
+      packets.push_back(std::move(packet));
+    }
+
+    offset += length;
+  }
+
+  std::ranges::stable_sort(packets, {}, &CapturedPacket::timestamp);
+  return packets;
+}
@@ -0,0 +1,243 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <sys/epoll.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+  const auto value{static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0))};
+  ++buckets_[bucket(value)];
+  ++count_;
+  total_ += value;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+auto LatencyHistogram::min() const -> std::chrono::nanoseconds {
+  return std::chrono::nanoseconds{count_ == 0 ? 0 : min_};
+}
+
+auto LatencyHistogram::mean() const -> std::chrono::nanoseconds {
+  return std::chrono::nanoseconds{count_ == 0 ? 0 : total_ / count_};
+}
+
+auto LatencyHistogram::percentile(double fraction) const
+    -> std::chrono::nanoseconds {
+  if (count_ == 0) {
+    return {};
+  }
+
+  const auto rank{std::max<uint64_t>(
+      static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_))),
+      1)};
+  uint64_t seen{0};
+  for (std::size_t i{0}; i < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::chrono::nanoseconds{std::min(upper_bound(i), max_)};
+    }
+  }
+
+  return max();
+}
+
+std::size_t LatencyHistogram::bucket(uint64_t value) {
+  if (value < linear_limit) {
+    return value;
+  }
+
+  const auto shift{static_cast<unsigned>(std::bit_width(value)) -
+                   sub_bucket_bits};
+  return linear_limit + (shift - 1) * sub_buckets +
+         ((value >> shift) - sub_buckets);
+}
+
+uint64_t LatencyHistogram::upper_bound(std::size_t bucket) {
+  if (bucket < linear_limit) {
+    return bucket;
+  }
+
+  const std::size_t offset{bucket - linear_limit};
+  const auto shift{static_cast<unsigned>(offset / sub_buckets) + 1};
+  const uint64_t top{sub_buckets + offset % sub_buckets};
+  return ((top + 1) << shift) - 1;
+}
+
+auto ReplayDriver::create(EventLoop &loop, std::vector<CapturedPacket> packets,
+                          ReplayOptions options)
+    -> std::expected<std::unique_ptr<ReplayDriver>, std::error_code> {
+  auto pair{TunDevice::create_pair()};
+  if (!pair) {
+    return std::unexpected{pair.error()};
+  }
+
+  for (const TunDevice &device : {pair->first, pair->second}) {
+    std::error_code error{set_nonblocking(device.fd())};
+    if (error) {
+      return std::unexpected{error};
+    }
+  }
+
+  // Outbound packets are what the data plane produced when recording; the
+  // replay regenerates them.
+  std::erase_if(packets, [](const CapturedPacket &packet) {
+    return packet.direction != CaptureDirection::inbound;
+  });
+
+  std::unique_ptr<ReplayDriver> driver{
+      new ReplayDriver{loop, std::move(packets), options,
+                       std::move(pair->first), std::move(pair->second)}};
+  std::error_code error{loop.add(driver->feed_.fd(), EPOLLIN,
+                                 [driver = driver.get()](uint32_t /*events*/) {
+                                   driver->drain_tun();
+                                 })};
+  if (error) {
+    return std::unexpected{error};
+  }
+
+  return driver;
+}
+
+ReplayDriver::ReplayDriver(EventLoop &loop, std::vector<CapturedPacket> packets,
+                           ReplayOptions options, TunDevice tun,
+                           TunDevice feed)
+    : loop_{loop}, packets_{std::move(packets)}, options_{options},
+      tun_{std::move(tun)}, feed_{std::move(feed)} {
+  stages_.push_back({.name = "inject"});
+}
+
+ReplayDriver::~ReplayDriver() {
+  std::error_code error{loop_.remove(feed_.fd())};
+  if (udp_bound_) {
+    error = loop_.remove(injector_.fd());
+  }
+  ::close(tun_.fd());
+  ::close(feed_.fd());
+}
+
+auto ReplayDriver::bind_udp(const Address &local, const Address &target)
+    -> std::error_code {
+  std::error_code error{injector_.bind({&local, 1})};
+  if (error) {
+    return error;
+  }
+
+  error = set_nonblocking(injector_.fd());
+  if (error) {
+    return error;
+  }
+
+  error = loop_.add(injector_.fd(), EPOLLIN,
+                    [this](uint32_t /*events*/) { drain_udp(); });
+  if (error) {
+    return error;
+  }
+
+  target_ = target;
+  udp_bound_ = true;
+  return {};
+}
+
+auto ReplayDriver::add_stage(std::string name) -> std::size_t {
+  stages_.push_back({.name = std::move(name)});
+  return stages_.size() - 1;
+}
+
+// Back-pressure from either feed yields to the loop so the data plane can
+// drain, then retries the same packet.
+Task<std::error_code> ReplayDriver::run() {
+  started_ = EventLoop::Clock::now();
+  finished_ = started_;
+  if (packets_.empty()) {
+    co_return std::error_code{};
+  }
+
+  const std::chrono::nanoseconds first{packets_.front().timestamp};
+  std::size_t since_yield{0};
+  for (const CapturedPacket &packet : packets_) {
+    if (packet.interface == CaptureInterface::udp && !udp_bound_) {
+      ++skipped_;
+      continue;
+    }
+
+    if (options_.original_rate) {
+      const auto due{started_ +
+                     std::chrono::duration_cast<EventLoop::Clock::duration>(
+                         packet.timestamp - first)};
+      // Always yield, even for a gap shorter than the spin, so the data plane
+      // has handled the previous packet before the next one is due.
+      co_await loop_.sleep_for(
+          std::max(due - EventLoop::Clock::now() - options_.spin,
+                   EventLoop::Clock::duration::zero()));
+      while (EventLoop::Clock::now() < due) {
+      }
+    } else if (++since_yield == options_.batch) {
+      since_yield = 0;
+      co_await loop_.sleep_for(EventLoop::Clock::duration::zero());
+    }
+
+    while (true) {
+      const auto before{EventLoop::Clock::now()};
+      std::error_code error{inject(packet)};
+      if (error == std::errc::resource_unavailable_try_again ||
+          error == std::errc::no_buffer_space) {
+        co_await loop_.sleep_for(EventLoop::Clock::duration::zero());
+        continue;
+      }
+      if (error) {
+        co_return error;
+      }
+
+      record(inject_stage, EventLoop::Clock::now() - before);
+      break;
+    }
+  }
+
+  finished_ = EventLoop::Clock::now();
+  co_await loop_.sleep_for(options_.drain);
+  co_return std::error_code{};
+}
+
+auto ReplayDriver::inject(const CapturedPacket &packet) -> std::error_code {
+  if (packet.interface == CaptureInterface::tun) {
+    std::error_code error{feed_.write(packet.data)};
+    if (!error) {
+      ++injected_;
+    }
+    return error;
+  }
+
+  std::error_code error{
+      injector_.write({.address = target_, .data = packet.data})};
+  if (!error) {
+    ++injected_;
+  }
+  return error;
+}
+
+void ReplayDriver::drain_tun() {
+  while (feed_.read()) {
+    ++egress_[static_cast<std::size_t>(CaptureInterface::tun)];
+    finished_ = EventLoop::Clock::now();
+  }
+}
+
+void ReplayDriver::drain_udp() {
+  while (injector_.read()) {
+    ++egress_[static_cast<std::size_t>(CaptureInterface::udp)];
+    finished_ = EventLoop::Clock::now();
+  }
+}
+
+auto ReplayDriver::elapsed() const -> EventLoop::Clock::duration {
+  return finished_ - started_;
+}
+
+double ReplayDriver::packets_per_second() const {
+  const double seconds{std::chrono::duration<double>{elapsed()}.count()};
+  return seconds > 0 ? static_cast<double>(injected_) / seconds : 0;
+}
@@ -4,6 +4,7 @@
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <system_error>
 #include <unistd.h>
@@ -35,7 +36,13 @@ std::expected<std::span<std::byte>, std::error_code> TunDevice::read() {
     return std::unexpected{std::error_code{errno, std::system_category()}};
   }
 
-  return std::span{buffer_.data(), static_cast<std::size_t>(bytes_read)};
+  std::span<std::byte> packet{buffer_.data(),
+                              static_cast<std::size_t>(bytes_read)};
+  if (capture_ != nullptr) {
+    capture_->record(CaptureInterface::tun, CaptureDirection::inbound, packet);
+  }
+
+  return packet;
 }
 
 std::error_code TunDevice::write(std::span<const std::byte> data) const {
@@ -43,6 +50,10 @@ std::error_code TunDevice::write(std::span<const std::byte> data) const {
     return {errno, std::system_category()};
   }
 
+  if (capture_ != nullptr) {
+    capture_->record(CaptureInterface::tun, CaptureDirection::outbound, data);
+  }
+
   return {};
 }
 
@@ -61,3 +72,16 @@ TunDevice::create_multiqueue(std::string_view name, std::size_t size,
 
   return multiqueue;
 }
+
+std::expected<std::pair<TunDevice, TunDevice>, std::error_code>
+TunDevice::create_pair() {
+  std::array<int, 2> fds{};
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds.data()) == -1) {
+    return std::unexpected{std::error_code{errno, std::system_category()}};
+  }
+
+  std::pair<TunDevice, TunDevice> pair{};
+  pair.first.fd_ = fds[0];
+  pair.second.fd_ = fds[1];
+  return pair;
+}
@@ -0,0 +1,314 @@
+#include "tun_steering.hpp"
+
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/bpf.h>
+#include <linux/if_tun.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+static auto bpf(bpf_cmd command, bpf_attr &attr) -> int {
+  return static_cast<int>(::syscall(__NR_bpf, command, &attr, sizeof(attr)));
+}
+
+static constexpr auto instruction(uint8_t code, uint8_t dst, uint8_t src,
+                                  int16_t off, int32_t imm) -> bpf_insn {
+  return {.code = code, .dst_reg = dst, .src_reg = src, .off = off, .imm = imm};
+}
+
+static constexpr uint8_t r0{0};
+static constexpr uint8_t r1{1};
+static constexpr uint8_t r2{2};
+static constexpr uint8_t r6{6};
+static constexpr uint8_t r10{10};
+
+// Returns the owning queue for the IPv4 destination, or the destination
+// itself (taken modulo the queue count by the kernel) when it has no owner.
+// LD_ABS reads packet bytes in host order, so map keys are host order too.
+static auto steering_program(int map_fd) -> std::array<bpf_insn, 18> {
+  return {{
+      instruction(BPF_ALU64 | BPF_MOV | BPF_X, r6, r1, 0, 0),
+      instruction(BPF_LD | BPF_ABS | BPF_B, r0, 0, 0, 0),
+      instruction(BPF_ALU64 | BPF_RSH | BPF_K, r0, 0, 0, 4),
+      instruction(BPF_JMP | BPF_JEQ | BPF_K, r0, 0, 12, 6),
+      instruction(BPF_LD | BPF_ABS | BPF_W, r0, 0, 0, 16),
+      instruction(BPF_STX | BPF_MEM | BPF_W, r10, r0, -4, 0),
+      instruction(BPF_LD | BPF_IMM | BPF_DW, r1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+      instruction(0, 0, 0, 0, 0),
+      instruction(BPF_ALU64 | BPF_MOV | BPF_X, r2, r10, 0, 0),
+      instruction(BPF_ALU64 | BPF_ADD | BPF_K, r2, 0, 0, -4),
+      instruction(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+      instruction(BPF_JMP | BPF_JEQ | BPF_K, r0, 0, 2, 0),
+      instruction(BPF_LDX | BPF_MEM | BPF_W, r0, r0, 0, 0),
+      instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+      instruction(BPF_LDX | BPF_MEM | BPF_W, r0, r10, -4, 0),
+      instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+      // IPv6: spread by the low 32 bits of the destination.
+      instruction(BPF_LD | BPF_ABS | BPF_W, r0, 0, 0, 36),
+      instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+  }};
+}
+
+static auto slot_key(uint64_t slot) -> uint32_t {
+  return static_cast<uint32_t>(slot >> 32);
+}
+
+static auto slot_queue(uint64_t slot) -> uint32_t {
+  return static_cast<uint32_t>(slot) - 1;
+}
+
+static auto ipv4_key(const Address &address) -> std::optional<uint32_t> {
+  if (address.storage.ss_family != AF_INET) {
+    return std::nullopt;
+  }
+
+  sockaddr_in ipv4{};
+  std::memcpy(&ipv4, &address.storage, sizeof(ipv4));
+  return ntohl(ipv4.sin_addr.s_addr);
+}
+
+TunSteering::~TunSteering() {
+  if (program_fd_ != -1) {
+    int detach{-1};
+    ::ioctl(device_fd_, TUNSETSTEERINGEBPF, &detach);
+    ::close(program_fd_);
+  }
+  if (map_fd_ != -1) {
+    ::close(map_fd_);
+  }
+}
+
+auto TunSteering::offload() -> std::error_code {
+  if (offloaded()) {
+    return {};
+  }
+  if (device_fd_ == -1) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+
+  // Hold the lock throughout so no steer() lands between copying the table
+  // into the map and the map becoming visible to it.
+  std::unique_lock lock{mutex_};
+  bpf_attr map{};
+  map.map_type = BPF_MAP_TYPE_HASH;
+  map.key_size = sizeof(uint32_t);
+  map.value_size = sizeof(uint32_t);
+  map.max_entries = static_cast<uint32_t>(max_peers_);
+  const int map_fd{bpf(BPF_MAP_CREATE, map)};
+  if (map_fd == -1) {
+    return {errno, std::system_category()};
+  }
+
+  for (const std::atomic<uint64_t> &slot : slots_) {
+    const uint64_t entry{slot.load(std::memory_order_relaxed)};
+    if (entry == empty) {
+      continue;
+    }
+
+    const uint32_t key{slot_key(entry)};
+    const uint32_t queue{slot_queue(entry)};
+    bpf_attr update{};
+    update.map_fd = map_fd;
+    update.key = reinterpret_cast<uintptr_t>(&key);
+    update.value = reinterpret_cast<uintptr_t>(&queue);
+    update.flags = BPF_ANY;
+    if (bpf(BPF_MAP_UPDATE_ELEM, update) == -1) {
+      const int update_errno{errno};
+      ::close(map_fd);
+      return {update_errno, std::system_category()};
+    }
+  }
+
+  const std::array<bpf_insn, 18> program{steering_program(map_fd)};
+  constexpr std::string_view license{"GPL"};
+  bpf_attr load{};
+  load.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+  load.insns = reinterpret_cast<uintptr_t>(program.data());
+  load.insn_cnt = program.size();
+  load.license = reinterpret_cast<uintptr_t>(license.data());
+  const int program_fd{bpf(BPF_PROG_LOAD, load)};
+  if (program_fd == -1) {
+    const int load_errno{errno};
+    ::close(map_fd);
+    return {load_errno, std::system_category()};
+  }
+
+  int attach{program_fd};
+  if (::ioctl(device_fd_, TUNSETSTEERINGEBPF, &attach) == -1) {
+    const int ioctl_errno{errno};
+    ::close(program_fd);
+    ::close(map_fd);
+    return {ioctl_errno, std::system_category()};
+  }
+
+  map_fd_ = map_fd;
+  program_fd_ = program_fd;
+  return {};
+}
+
+auto TunSteering::steer(const Address &inner, std::size_t queue)
+    -> std::error_code {
+  if (queue >= queue_count_) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+
+  auto key{ipv4_key(inner)};
+  if (!key) {
+    return std::make_error_code(std::errc::address_family_not_supported);
+  }
+
+  std::unique_lock lock{mutex_};
+  const std::size_t mask{slots_.size() - 1};
+  std::size_t index{home(*key)};
+  uint64_t entry{slots_[index].load(std::memory_order_relaxed)};
+  while (entry != empty && slot_key(entry) != *key) {
+    index = (index + 1) & mask;
+    entry = slots_[index].load(std::memory_order_relaxed);
+  }
+  const bool inserting{entry == empty};
+  if (inserting && peers_ == max_peers_) {
+    return std::make_error_code(std::errc::no_space_on_device);
+  }
+
+  const auto value{static_cast<uint32_t>(queue)};
+  if (map_fd_ != -1) {
+    bpf_attr update{};
+    update.map_fd = map_fd_;
+    update.key = reinterpret_cast<uintptr_t>(&*key);
+    update.value = reinterpret_cast<uintptr_t>(&value);
+    update.flags = BPF_ANY;
+    if (bpf(BPF_MAP_UPDATE_ELEM, update) == -1) {
+      return {errno, std::system_category()};
+    }
+  }
+
+  begin_write();
+  slots_[index].store(uint64_t{*key} << 32 | (value + 1),
+                      std::memory_order_relaxed);
+  end_write();
+  if (inserting) {
+    ++peers_;
+  }
+  return {};
+}
+
+// Deletes by shifting later entries of the probe sequence back into the
+// hole, so the table never fills with tombstones.
+auto TunSteering::unsteer(const Address &inner) -> std::error_code {
+  auto key{ipv4_key(inner)};
+  if (!key) {
+    return std::make_error_code(std::errc::address_family_not_supported);
+  }
+
+  std::unique_lock lock{mutex_};
+  const std::size_t mask{slots_.size() - 1};
+  std::size_t hole{home(*key)};
+  while (true) {
+    const uint64_t entry{slots_[hole].load(std::memory_order_relaxed)};
+    if (entry == empty) {
+      return {};
+    }
+    if (slot_key(entry) == *key) {
+      break;
+    }
+    hole = (hole + 1) & mask;
+  }
+
+  if (map_fd_ != -1) {
+    bpf_attr remove{};
+    remove.map_fd = map_fd_;
+    remove.key = reinterpret_cast<uintptr_t>(&*key);
+    if (bpf(BPF_MAP_DELETE_ELEM, remove) == -1 && errno != ENOENT) {
+      return {errno, std::system_category()};
+    }
+  }
+
+  begin_write();
+  for (std::size_t index{(hole + 1) & mask};; index = (index + 1) & mask) {
+    const uint64_t entry{slots_[index].load(std::memory_order_relaxed)};
+    if (entry == empty) {
+      break;
+    }
+    if (((index - home(slot_key(entry))) & mask) >= ((index - hole) & mask)) {
+      slots_[hole].store(entry, std::memory_order_relaxed);
+      hole = index;
+    }
+  }
+  slots_[hole].store(empty, std::memory_order_relaxed);
+  end_write();
+  --peers_;
+  return {};
+}
+
+auto TunSteering::owner(std::span<const std::byte> packet) const
+    -> std::optional<std::size_t> {
+  constexpr std::size_t ipv4_header_size{20};
+  constexpr std::size_t destination_offset{16};
+  if (packet.size() < ipv4_header_size ||
+      (std::to_integer<uint8_t>(packet[0]) >> 4) != 4) {
+    return std::nullopt;
+  }
+
+  uint32_t destination{};
+  std::memcpy(&destination, &packet[destination_offset], sizeof(destination));
+  const uint32_t key{ntohl(destination)};
+
+  while (true) {
+    const uint64_t version{version_.load(std::memory_order_acquire)};
+    if ((version & 1) != 0) {
+      continue;
+    }
+
+    const std::optional<std::size_t> owner{lookup(key)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version_.load(std::memory_order_relaxed) == version) {
+      return owner;
+    }
+  }
+}
+
+// Fibonacci hashing, so neighbouring addresses land far apart.
+auto TunSteering::home(uint32_t key) const -> std::size_t {
+  return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15) >> 32) &
+         (slots_.size() - 1);
+}
+
+auto TunSteering::lookup(uint32_t key) const -> std::optional<std::size_t> {
+  const std::size_t mask{slots_.size() - 1};
+  std::size_t index{home(key)};
+  // A torn read during a concurrent write is retried by the caller, but must
+  // still terminate.
+  for (std::size_t probes{0}; probes < slots_.size(); ++probes) {
+    const uint64_t entry{slots_[index].load(std::memory_order_relaxed)};
+    if (entry == empty) {
+      return std::nullopt;
+    }
+    if (slot_key(entry) == key) {
+      return slot_queue(entry);
+    }
+    index = (index + 1) & mask;
+  }
+
+  return std::nullopt;
+}
+
+void TunSteering::begin_write() {
+  version_.store(version_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TunSteering::end_write() {
+  version_.store(version_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+}
@@ -58,9 +58,14 @@ auto UdpSocket::read() -> std::expected<Message, std::error_code> {
   if (bytes_read < 0) {
     return std::unexpected{std::error_code{errno, std::system_category()}};
   }
-  return Message{
+  Message message{
       .address = {address, address_length},
       .data = {buffer_.data(), static_cast<std::size_t>(bytes_read)}};
+  if (capture_ != nullptr) {
+    capture_->record(CaptureInterface::udp, CaptureDirection::inbound,
+                     message.data);
+  }
+  return message;
 }
 
 auto UdpSocket::write(const Message &message) -> std::error_code {
@@ -81,6 +86,11 @@ auto UdpSocket::write(const Message &message) -> std::error_code {
     return {errno, std::system_category()};
   }
 
+  if (capture_ != nullptr) {
+    capture_->record(CaptureInterface::udp, CaptureDirection::outbound,
+                     message.data);
+  }
+
   bound_ = true;
   return {};
 }
@@ -0,0 +1,156 @@
+#include "event_loop.hpp"
+#include "multipath.hpp"
+#include "packet_capture.hpp"
+#include "replay.hpp"
+#include "task.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <netdb.h>
+#include <new>
+#include <string_view>
+#include <sys/socket.h>
+
+// Counts every global allocation so the report can show what the data plane
+// allocates per packet.
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory{std::malloc(size == 0 ? 1 : size)}) {
+    return memory;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t /*size*/) noexcept {
+  std::free(memory);
+}
+
+static Task<> replay(EventLoop &loop, ReplayDriver &driver,
+                     std::error_code &error) {
+  error = co_await driver.run();
+  loop.stop();
+}
+
+static void print(const ReplayStage &stage) {
+  const auto microseconds{[](std::chrono::nanoseconds latency) {
+    return std::chrono::duration<double, std::micro>{latency}.count();
+  }};
+  std::cout << std::left << std::setw(12) << stage.name << std::right
+            << std::setw(10) << stage.latency.count() << std::fixed
+            << std::setprecision(2) << std::setw(10)
+            << microseconds(stage.latency.percentile(0.5)) << std::setw(10)
+            << microseconds(stage.latency.percentile(0.99)) << std::setw(10)
+            << microseconds(stage.latency.max()) << '\n';
+}
+
+auto main(int argc, char *argv[]) -> int {
+  if (argc < 2) {
+    std::cerr << "usage: replay <capture.pcapng> [--fast]\n";
+    return EXIT_FAILURE;
+  }
+  const bool fast{argc > 2 && std::string_view{argv[2]} == "--fast"};
+
+  auto packets{PacketCapture::load(argv[1])};
+  if (!packets) {
+    std::cerr << "PacketCapture::load: " << packets.error().message() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  EventLoop loop{};
+  auto driver{ReplayDriver::create(loop, std::move(*packets),
+                                   {.original_rate = !fast})};
+  if (!driver) {
+    std::cerr << "ReplayDriver::create: " << driver.error().message() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  AddressResolver resolver{};
+  auto local{resolver.resolve({.host = "127.0.0.1",
+                               .service = "47301",
+                               .flags = AI_NUMERICHOST,
+                               .family = AF_INET,
+                               .type = SOCK_DGRAM})};
+  auto remote{resolver.resolve({.host = "127.0.0.1",
+                                .service = "47302",
+                                .flags = AI_NUMERICHOST,
+                                .family = AF_INET,
+                                .type = SOCK_DGRAM})};
+  if (!local || !remote) {
+    std::cerr << "AddressResolver::resolve: failed\n";
+    return EXIT_FAILURE;
+  }
+
+  // The data plane under test: TUN packets go out through a multipath peer,
+  // and what the peer delivers is written back to the TUN.
+  ReplayDriver &replay_driver{**driver};
+  TunDevice &tun{replay_driver.tun()};
+  const std::size_t tun_to_udp{replay_driver.add_stage("tun_to_udp")};
+  const std::size_t udp_to_tun{replay_driver.add_stage("udp_to_tun")};
+  MultipathPeer peer{loop, [&](std::span<const std::byte> data) {
+                       ScopedStage stage{replay_driver, udp_to_tun};
+                       std::error_code error{tun.write(data)};
+                     }};
+
+  std::error_code error{peer.add_path(local->front(), remote->front())};
+  if (!error) {
+    error = replay_driver.bind_udp(remote->front(), local->front());
+  }
+  if (!error) {
+    error = loop.add(tun.fd(), EPOLLIN, [&](uint32_t /*events*/) {
+      while (true) {
+        const auto start{EventLoop::Clock::now()};
+        auto packet{tun.read()};
+        if (!packet) {
+          return;
+        }
+        std::error_code send_error{peer.send(*packet)};
+        replay_driver.record(tun_to_udp, EventLoop::Clock::now() - start);
+      }
+    });
+  }
+  if (error) {
+    std::cerr << "setup: " << error.message() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  spawn(loop, replay(loop, replay_driver, error));
+  const uint64_t allocations_before{allocations.load()};
+  std::error_code loop_error{loop.start()};
+  const uint64_t allocated{allocations.load() - allocations_before};
+  if (loop_error || error) {
+    std::cerr << "replay: " << (loop_error ? loop_error : error).message()
+              << '\n';
+    return EXIT_FAILURE;
+  }
+
+  const uint64_t injected{replay_driver.injected()};
+  std::cout << "injected     " << injected << " packets ("
+            << replay_driver.skipped() << " skipped)\n"
+            << "egress       tun " << replay_driver.egress(CaptureInterface::tun)
+            << ", udp " << replay_driver.egress(CaptureInterface::udp) << '\n'
+            << "elapsed      " << std::fixed << std::setprecision(3)
+            << std::chrono::duration<double, std::milli>{replay_driver.elapsed()}
+                   .count()
+            << " ms\n"
+            << "rate         " << std::setprecision(0)
+            << replay_driver.packets_per_second() << " pps\n"
+            << "allocations  " << allocated << " ("
+            << std::setprecision(3)
+            << (injected == 0 ? 0.0
+                              : static_cast<double>(allocated) /
+                                    static_cast<double>(injected))
+            << " per packet)\n\n";
+
+  std::cout << std::left << std::setw(12) << "stage" << std::right
+            << std::setw(10) << "count" << std::setw(10) << "p50 us"
+            << std::setw(10) << "p99 us" << std::setw(10) << "max us" << '\n';
+  for (const ReplayStage &stage : replay_driver.stages()) {
+    print(stage);
+  }
+}
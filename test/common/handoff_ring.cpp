@@ -0,0 +1,84 @@
+#include "event_loop.hpp"
+#include "handoff_ring.hpp"
+#include <cstring>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+static auto bytes(const uint32_t &value) -> std::span<const std::byte> {
+  return std::as_bytes(std::span{&value, 1});
+}
+
+static auto value(std::span<const std::byte> packet) -> uint32_t {
+  uint32_t result{};
+  std::memcpy(&result, packet.data(), sizeof(result));
+  return result;
+}
+
+TEST(HandoffRing, DrainsInPushOrder) {
+  auto ring{HandoffRing::create(4, 64)};
+  ASSERT_TRUE(ring) << ring.error().message();
+
+  for (uint32_t i{0}; i < 3; ++i) {
+    ASSERT_TRUE((*ring)->push(bytes(i)));
+  }
+
+  std::vector<uint32_t> drained{};
+  EXPECT_EQ((*ring)->drain([&](auto packet) {
+    drained.push_back(value(packet));
+  }),
+            3);
+  EXPECT_EQ(drained, (std::vector<uint32_t>{0, 1, 2}));
+}
+
+TEST(HandoffRing, RejectsWhenFullOrOversized) {
+  auto ring{HandoffRing::create(2, 4)};
+  ASSERT_TRUE(ring) << ring.error().message();
+
+  const uint64_t oversized{};
+  EXPECT_FALSE((*ring)->push(std::as_bytes(std::span{&oversized, 1})));
+  EXPECT_TRUE((*ring)->push(bytes(1)));
+  EXPECT_TRUE((*ring)->push(bytes(2)));
+  EXPECT_FALSE((*ring)->push(bytes(3)));
+
+  EXPECT_EQ((*ring)->drain([](auto) {}), 2);
+  EXPECT_TRUE((*ring)->push(bytes(4)));
+}
+
+TEST(HandoffRing, WakesConsumerLoop) {
+  constexpr uint32_t producers{4};
+  constexpr uint32_t per_producer{10000};
+  auto ring{HandoffRing::create(256, 64)};
+  ASSERT_TRUE(ring) << ring.error().message();
+
+  EventLoop loop{};
+  std::vector<uint32_t> next(producers);
+  std::size_t received{};
+  ASSERT_FALSE(loop.add((*ring)->fd(), EPOLLIN, [&](uint32_t /*events*/) {
+    received += (*ring)->drain([&](auto packet) {
+      const uint32_t packed{value(packet)};
+      EXPECT_EQ(packed % per_producer, next[packed / per_producer]++);
+    });
+    if (received == producers * per_producer) {
+      loop.stop();
+    }
+  }));
+
+  std::vector<std::thread> threads{};
+  for (uint32_t producer{0}; producer < producers; ++producer) {
+    threads.emplace_back([&, producer] {
+      for (uint32_t i{0}; i < per_producer; ++i) {
+        const uint32_t packed{producer * per_producer + i};
+        while (!(*ring)->push(bytes(packed))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  ASSERT_FALSE(loop.start());
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(received, producers * per_producer);
+}
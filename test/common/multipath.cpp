@@ -0,0 +1,261 @@
+#include "multipath.hpp"
+#include "task.hpp"
+#include <arpa/inet.h>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <system_error>
+
+using namespace std::chrono_literals;
+
+static auto collect(std::vector<uint32_t> &delivered) -> Deliver {
+  return [&delivered](std::span<const std::byte> data) {
+    uint32_t value{};
+    std::memcpy(&value, data.data(), sizeof(value));
+    delivered.push_back(value);
+  };
+}
+
+static void push(ReorderBuffer &buffer, uint32_t sequence,
+                 const Deliver &deliver, uint32_t epoch = 0) {
+  buffer.push(epoch, sequence, std::as_bytes(std::span{&sequence, 1}),
+              deliver);
+}
+
+TEST(ReorderBuffer, DeliversInOrder) {
+  std::vector<uint32_t> delivered{};
+  Deliver deliver{collect(delivered)};
+  ReorderBuffer buffer{8, 64};
+  push(buffer, 0, deliver);
+  push(buffer, 2, deliver);
+  push(buffer, 3, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0}));
+  EXPECT_TRUE(buffer.waiting());
+  push(buffer, 1, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 1, 2, 3}));
+  EXPECT_FALSE(buffer.waiting());
+}
+
+TEST(ReorderBuffer, SkipGap) {
+  std::vector<uint32_t> delivered{};
+  Deliver deliver{collect(delivered)};
+  ReorderBuffer buffer{8, 64};
+  push(buffer, 0, deliver);
+  push(buffer, 2, deliver);
+  push(buffer, 3, deliver);
+  buffer.skip(deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 2, 3}));
+  push(buffer, 1, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 2, 3}));
+}
+
+TEST(ReorderBuffer, WindowOverflowSkipsOldestGap) {
+  std::vector<uint32_t> delivered{};
+  Deliver deliver{collect(delivered)};
+  ReorderBuffer buffer{4, 64};
+  push(buffer, 0, deliver);
+  push(buffer, 2, deliver);
+  push(buffer, 5, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 2}));
+  push(buffer, 1, deliver);
+  push(buffer, 3, deliver);
+  push(buffer, 4, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 2, 3, 4, 5}));
+}
+
+TEST(ReorderBuffer, LatePacketOnSlowPathIsDropped) {
+  std::vector<uint32_t> delivered{};
+  Deliver deliver{collect(delivered)};
+  ReorderBuffer buffer{4, 64};
+  for (uint32_t sequence{1}; sequence <= 10; ++sequence) {
+    push(buffer, sequence, deliver);
+  }
+  push(buffer, 12, deliver);
+  push(buffer, 13, deliver);
+  push(buffer, 0, deliver);
+  EXPECT_EQ(delivered,
+            (std::vector<uint32_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+  push(buffer, 11, deliver);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                              11, 12, 13}));
+}
+
+TEST(ReorderBuffer, JoinsMidStream) {
+  for (const uint32_t first : {5000U, 0x80000000U}) {
+    uint32_t count{};
+    const Deliver deliver{[&count](std::span<const std::byte>) { ++count; }};
+    ReorderBuffer buffer{1024, 64};
+    for (uint32_t sequence{first}; sequence != first + 100000; ++sequence) {
+      push(buffer, sequence, deliver, 3);
+      ASSERT_FALSE(buffer.waiting()) << first;
+    }
+    EXPECT_EQ(count, 100000) << first;
+  }
+}
+
+TEST(ReorderBuffer, ResyncAfterSenderRestart) {
+  std::vector<uint32_t> delivered{};
+  Deliver deliver{collect(delivered)};
+  ReorderBuffer buffer{4, 64};
+  for (uint32_t sequence{0}; sequence < 100; ++sequence) {
+    push(buffer, sequence, deliver, 7);
+  }
+  delivered.clear();
+  push(buffer, 1, deliver, 8);
+  push(buffer, 0, deliver, 8);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 1}));
+  EXPECT_EQ(buffer.epoch(), 8);
+
+  // A straggler from before the restart must not rewind the new epoch.
+  push(buffer, 100, deliver, 7);
+  push(buffer, 2, deliver, 8);
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 1, 2}));
+}
+
+class MultipathPeerTest : public testing::Test {
+protected:
+  EventLoop loop_;
+  AddressResolver resolver_;
+  EventLoop::Timer deadline_;
+
+  void SetUp() override {
+    deadline_.callback = [this] { loop_.stop(); };
+    deadline_.deadline = EventLoop::Clock::now() + 5s;
+    loop_.schedule(deadline_);
+  }
+
+  auto address(const char *host, const char *port) -> Address {
+    auto addresses{resolver_.resolve({.host = host,
+                                      .service = port,
+                                      .flags = AI_NUMERICHOST,
+                                      .family = AF_INET,
+                                      .type = SOCK_DGRAM})};
+    EXPECT_TRUE(addresses) << addresses.error().message();
+    return addresses->front();
+  }
+};
+
+static Task<> send_sequence(EventLoop &loop, MultipathPeer &peer,
+                            uint32_t count) {
+  co_await loop.sleep_for(20ms);
+  for (uint32_t sequence{0}; sequence < count; ++sequence) {
+    EXPECT_FALSE(peer.send(std::as_bytes(std::span{&sequence, 1})));
+    if (sequence % 64 == 63) {
+      co_await loop.sleep_for(1ms);
+    }
+  }
+}
+
+TEST_F(MultipathPeerTest, StripesAcrossPathsInOrder) {
+  constexpr uint32_t count{2000};
+  std::vector<uint32_t> delivered{};
+  MultipathPeer sender{loop_, [](std::span<const std::byte>) {},
+                       {.probe_interval = 5ms}};
+  MultipathPeer receiver{loop_,
+                         [&](std::span<const std::byte> data) {
+                           collect(delivered)(data);
+                           if (delivered.size() == count) {
+                             loop_.stop();
+                           }
+                         },
+                         {.probe_interval = 5ms}};
+
+  ASSERT_FALSE(sender.add_path(address("127.0.0.1", "47101"),
+                               address("127.0.0.1", "47201")));
+  ASSERT_FALSE(sender.add_path(address("127.0.0.2", "47102"),
+                               address("127.0.0.2", "47202")));
+  ASSERT_FALSE(receiver.add_path(address("127.0.0.1", "47201"),
+                                 address("127.0.0.1", "47101")));
+  ASSERT_FALSE(receiver.add_path(address("127.0.0.2", "47202"),
+                                 address("127.0.0.2", "47102")));
+  sender.start();
+  receiver.start();
+
+  spawn(loop_, send_sequence(loop_, sender, count));
+  ASSERT_FALSE(loop_.start());
+
+  ASSERT_EQ(delivered.size(), count);
+  for (uint32_t sequence{0}; sequence < count; ++sequence) {
+    ASSERT_EQ(delivered[sequence], sequence);
+  }
+  EXPECT_GT(sender.path(0).packets_sent, count / 10);
+  EXPECT_GT(sender.path(1).packets_sent, count / 10);
+}
+
+static Task<> stop_after(EventLoop &loop, EventLoop::Clock::duration delay) {
+  co_await loop.sleep_for(delay);
+  loop.stop();
+}
+
+TEST_F(MultipathPeerTest, UnansweredPathGoesDown) {
+  MultipathPeer sender{loop_, [](std::span<const std::byte>) {},
+                       {.probe_interval = 5ms, .probe_loss_threshold = 3}};
+  MultipathPeer receiver{loop_, [](std::span<const std::byte>) {},
+                         {.probe_interval = 5ms}};
+
+  ASSERT_FALSE(sender.add_path(address("127.0.0.1", "47111"),
+                               address("127.0.0.1", "47211")));
+  ASSERT_FALSE(sender.add_path(address("127.0.0.2", "47112"),
+                               address("127.0.0.2", "47299")));
+  ASSERT_FALSE(receiver.add_path(address("127.0.0.1", "47211"),
+                                 address("127.0.0.1", "47111")));
+  sender.start();
+  receiver.start();
+
+  spawn(loop_, stop_after(loop_, 50ms));
+  ASSERT_FALSE(loop_.start());
+
+  EXPECT_TRUE(sender.path(0).up);
+  EXPECT_FALSE(sender.path(1).up);
+  EXPECT_GT(sender.path(1).loss, 0.0);
+
+  const uint64_t sent_before{sender.path(1).packets_sent};
+  const uint32_t value{};
+  for (int i{0}; i < 10; ++i) {
+    EXPECT_FALSE(sender.send(std::as_bytes(std::span{&value, 1})));
+  }
+  EXPECT_EQ(sender.path(1).packets_sent, sent_before);
+}
+
+static Task<> send_frames(EventLoop &loop, UdpSocket &socket,
+                          const Address &peer) {
+  const auto frame{[&](uint32_t sequence) {
+    std::array<std::byte, 12> data{};
+    data[3] = std::byte{1};
+    const uint32_t network_sequence{htonl(sequence)};
+    std::memcpy(&data[4], &network_sequence, sizeof(network_sequence));
+    std::memcpy(&data[8], &sequence, sizeof(sequence));
+    EXPECT_FALSE(socket.write({.address = peer, .data = data}));
+  }};
+
+  frame(0);
+  frame(2);
+  co_await loop.sleep_for(4ms);
+  frame(4);
+  frame(1);
+  co_await loop.sleep_for(2ms);
+  frame(3);
+  co_await loop.sleep_for(10ms);
+  loop.stop();
+}
+
+// Gap 1 opens at 0ms and fills at 4ms, when gap 3 becomes the head. Gap 3
+// must get its own timeout rather than inherit what was left of gap 1's.
+TEST_F(MultipathPeerTest, ReorderTimeoutFollowsHeadGap) {
+  std::vector<uint32_t> delivered{};
+  MultipathPeer receiver{loop_, collect(delivered),
+                         {.min_reorder_timeout = 5ms}};
+  const Address local{address("127.0.0.1", "47121")};
+  const Address remote{address("127.0.0.1", "47221")};
+  ASSERT_FALSE(receiver.add_path(local, remote));
+
+  UdpSocket sender{};
+  ASSERT_FALSE(sender.bind({&remote, 1}));
+  spawn(loop_, send_frames(loop_, sender, local));
+  ASSERT_FALSE(loop_.start());
+
+  EXPECT_EQ(delivered, (std::vector<uint32_t>{0, 1, 2, 3, 4}));
+}
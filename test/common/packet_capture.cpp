@@ -0,0 +1,143 @@
+#include "packet_capture.hpp"
+#include "tun_device.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+class PacketCaptureTest : public testing::Test {
+protected:
+  std::string path_{(std::filesystem::temp_directory_path() /
+                     ("mouse_capture_" + std::to_string(::getpid()) +
+                      ".pcapng"))
+                        .string()};
+
+  void TearDown() override { std::remove(path_.c_str()); }
+};
+
+static auto bytes(std::string_view text) -> std::span<const std::byte> {
+  return std::as_bytes(std::span{text.data(), text.size()});
+}
+
+static auto text(const CapturedPacket &packet) -> std::string {
+  return {reinterpret_cast<const char *>(packet.data.data()),
+          packet.data.size()};
+}
+
+TEST_F(PacketCaptureTest, RecordAndLoad) {
+  {
+    auto capture{PacketCapture::create(path_, 8)};
+    ASSERT_TRUE(capture) << capture.error().message();
+    capture->record(CaptureInterface::tun, CaptureDirection::inbound,
+                    bytes("first"));
+    capture->record(CaptureInterface::udp, CaptureDirection::outbound,
+                    bytes("second packet"));
+  }
+
+  auto packets{PacketCapture::load(path_)};
+  ASSERT_TRUE(packets) << packets.error().message();
+  ASSERT_EQ(packets->size(), 2);
+  EXPECT_EQ((*packets)[0].interface, CaptureInterface::tun);
+  EXPECT_EQ((*packets)[0].direction, CaptureDirection::inbound);
+  EXPECT_EQ(text((*packets)[0]), "first");
+  EXPECT_EQ((*packets)[1].interface, CaptureInterface::udp);
+  EXPECT_EQ((*packets)[1].direction, CaptureDirection::outbound);
+  EXPECT_EQ(text((*packets)[1]), "second packet");
+  EXPECT_LE((*packets)[0].timestamp, (*packets)[1].timestamp);
+}
+
+TEST_F(PacketCaptureTest, RingKeepsNewest) {
+  {
+    auto capture{PacketCapture::create(path_, 3, 4)};
+    ASSERT_TRUE(capture) << capture.error().message();
+    for (std::string_view packet : {"p0", "p1", "p2", "p3", "p4truncated"}) {
+      capture->record(CaptureInterface::tun, CaptureDirection::inbound,
+                      bytes(packet));
+    }
+    EXPECT_EQ(capture->recorded(), 5);
+  }
+
+  auto packets{PacketCapture::load(path_)};
+  ASSERT_TRUE(packets) << packets.error().message();
+  ASSERT_EQ(packets->size(), 3);
+  EXPECT_EQ(text((*packets)[0]), "p2");
+  EXPECT_EQ(text((*packets)[1]), "p3");
+  EXPECT_EQ(text((*packets)[2]), "p4tr");
+}
+
+TEST_F(PacketCaptureTest, DevicesRecordBothDirections) {
+  auto capture{PacketCapture::create(path_, 8)};
+  ASSERT_TRUE(capture) << capture.error().message();
+  auto pair{TunDevice::create_pair()};
+  ASSERT_TRUE(pair) << pair.error().message();
+  pair->first.capture(&*capture);
+
+  ASSERT_FALSE(pair->first.write(bytes("out")));
+  ASSERT_FALSE(pair->second.write(bytes("in")));
+  ASSERT_TRUE(pair->first.read());
+  EXPECT_EQ(capture->recorded(), 2);
+  ::close(pair->first.fd());
+  ::close(pair->second.fd());
+}
+
+// Walks the file the way a strict pcapng reader does: every block must have a
+// sane length that matches its trailing copy, and the blocks must end exactly
+// at the end of the file.
+static auto block_types(const std::string &path) -> std::vector<uint32_t> {
+  std::ifstream file{path, std::ios::binary};
+  std::vector<char> contents{std::istreambuf_iterator<char>{file},
+                             std::istreambuf_iterator<char>{}};
+  std::vector<uint32_t> types{};
+  std::size_t offset{0};
+  while (offset < contents.size()) {
+    uint32_t type{};
+    uint32_t length{};
+    uint32_t trailing{};
+    EXPECT_LE(offset + 12, contents.size());
+    std::memcpy(&type, &contents[offset], sizeof(type));
+    std::memcpy(&length, &contents[offset + 4], sizeof(length));
+    EXPECT_GE(length, 12);
+    EXPECT_EQ(length % 4, 0);
+    if (length < 12 || offset + length > contents.size()) {
+      ADD_FAILURE() << "bad block at " << offset;
+      break;
+    }
+    std::memcpy(&trailing, &contents[offset + length - 4], sizeof(trailing));
+    EXPECT_EQ(trailing, length);
+    types.push_back(type);
+    offset += length;
+  }
+  EXPECT_EQ(offset, contents.size());
+  return types;
+}
+
+TEST_F(PacketCaptureTest, LiveFileIsValidPcapng) {
+  auto capture{PacketCapture::create(path_, 4)};
+  ASSERT_TRUE(capture) << capture.error().message();
+  capture->record(CaptureInterface::tun, CaptureDirection::inbound,
+                  bytes("first"));
+
+  // Still open, as if the recording process had crashed.
+  const std::vector<uint32_t> types{block_types(path_)};
+  ASSERT_EQ(types.size(), 7);
+  EXPECT_EQ(types[0], 0x0A0D0D0A);
+  EXPECT_EQ(types[1], 1);
+  EXPECT_EQ(types[2], 1);
+  EXPECT_EQ(types[3], 6);
+  for (std::size_t index{4}; index < types.size(); ++index) {
+    EXPECT_EQ(types[index], 0x40000BAD);
+  }
+
+  auto packets{PacketCapture::load(path_)};
+  ASSERT_TRUE(packets) << packets.error().message();
+  ASSERT_EQ(packets->size(), 1);
+  EXPECT_EQ(text((*packets)[0]), "first");
+}
+
+TEST_F(PacketCaptureTest, LoadMissingFile) {
+  EXPECT_FALSE(PacketCapture::load(path_ + ".missing"));
+}
@@ -0,0 +1,126 @@
+#include "replay.hpp"
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogram, Percentiles) {
+  LatencyHistogram histogram{};
+  for (int i{1}; i <= 100; ++i) {
+    histogram.record(std::chrono::nanoseconds{i * 1000});
+  }
+
+  EXPECT_EQ(histogram.count(), 100);
+  EXPECT_EQ(histogram.min(), 1us);
+  EXPECT_EQ(histogram.max(), 100us);
+  EXPECT_NEAR(histogram.mean().count(), 50500, 1);
+  EXPECT_GE(histogram.percentile(0.5), 50us);
+  EXPECT_LE(histogram.percentile(0.5), 50us * 1.125);
+  EXPECT_GE(histogram.percentile(0.99), 99us);
+  EXPECT_LE(histogram.percentile(0.99), 100us);
+}
+
+static auto packet(CaptureInterface interface, CaptureDirection direction,
+                   std::chrono::nanoseconds timestamp) -> CapturedPacket {
+  return {.interface = interface,
+          .direction = direction,
+          .timestamp = timestamp,
+          .data = std::vector<std::byte>(64, std::byte{0x45})};
+}
+
+static Task<> replay(EventLoop &loop, ReplayDriver &driver,
+                     std::error_code &error) {
+  error = co_await driver.run();
+  loop.stop();
+}
+
+TEST(ReplayDriver, FeedsInboundTunPackets) {
+  std::vector<CapturedPacket> packets{};
+  for (int i{0}; i < 500; ++i) {
+    packets.push_back(packet(CaptureInterface::tun, CaptureDirection::inbound,
+                             std::chrono::nanoseconds{i}));
+    packets.push_back(packet(CaptureInterface::tun, CaptureDirection::outbound,
+                             std::chrono::nanoseconds{i}));
+  }
+  packets.push_back(packet(CaptureInterface::udp, CaptureDirection::inbound,
+                           std::chrono::nanoseconds{500}));
+
+  EventLoop loop{};
+  auto driver{ReplayDriver::create(loop, std::move(packets),
+                                   {.original_rate = false, .drain = 5ms})};
+  ASSERT_TRUE(driver) << driver.error().message();
+
+  // Echo data plane: every packet read from the TUN is written straight back.
+  TunDevice &tun{(*driver)->tun()};
+  const std::size_t echo{(*driver)->add_stage("echo")};
+  ASSERT_FALSE(loop.add(tun.fd(), EPOLLIN, [&](uint32_t /*events*/) {
+    while (true) {
+      ScopedStage stage{**driver, echo};
+      auto read{tun.read()};
+      if (!read) {
+        return;
+      }
+      EXPECT_FALSE(tun.write(*read));
+    }
+  }));
+
+  std::error_code error{};
+  spawn(loop, replay(loop, **driver, error));
+  ASSERT_FALSE(loop.start());
+  ASSERT_FALSE(error) << error.message();
+
+  EXPECT_EQ((*driver)->injected(), 500);
+  EXPECT_EQ((*driver)->skipped(), 1);
+  EXPECT_EQ((*driver)->egress(CaptureInterface::tun), 500);
+  EXPECT_EQ((*driver)->stages()[ReplayDriver::inject_stage].latency.count(),
+            500);
+  EXPECT_GT((*driver)->packets_per_second(), 0);
+  EXPECT_FALSE(loop.remove(tun.fd()));
+}
+
+TEST(ReplayDriver, KeepsSubMillisecondGaps) {
+  // 100us and 250us gaps alternating: rounding waits to whole milliseconds
+  // would turn them into bursts.
+  std::vector<std::chrono::nanoseconds> gaps{};
+  std::vector<CapturedPacket> packets{};
+  std::chrono::nanoseconds timestamp{};
+  for (int i{0}; i < 200; ++i) {
+    packets.push_back(
+        packet(CaptureInterface::tun, CaptureDirection::inbound, timestamp));
+    gaps.push_back(i % 2 == 0 ? 100us : 250us);
+    timestamp += gaps.back();
+  }
+  gaps.pop_back();
+
+  EventLoop loop{};
+  auto driver{ReplayDriver::create(loop, std::move(packets), {.drain = 1ms})};
+  ASSERT_TRUE(driver) << driver.error().message();
+
+  TunDevice &tun{(*driver)->tun()};
+  std::vector<EventLoop::Clock::time_point> arrivals{};
+  arrivals.reserve(200);
+  ASSERT_FALSE(loop.add(tun.fd(), EPOLLIN, [&](uint32_t /*events*/) {
+    while (tun.read()) {
+      arrivals.push_back(EventLoop::Clock::now());
+    }
+  }));
+
+  std::error_code error{};
+  spawn(loop, replay(loop, **driver, error));
+  ASSERT_FALSE(loop.start());
+  ASSERT_FALSE(error) << error.message();
+  ASSERT_EQ(arrivals.size(), 200);
+
+  // A preempted data plane shows up as the odd late packet followed by an
+  // early one, so judge the typical gap rather than every gap. Waits rounded
+  // to whole milliseconds put the median error at the size of a gap.
+  std::vector<std::chrono::nanoseconds> errors{};
+  for (std::size_t i{0}; i < gaps.size(); ++i) {
+    errors.push_back(std::chrono::abs(arrivals[i + 1] - arrivals[i] - gaps[i]));
+  }
+  std::ranges::nth_element(errors, errors.begin() + errors.size() / 2);
+  EXPECT_LE(errors[errors.size() / 2], 50us);
+  EXPECT_LT((*driver)->elapsed(), timestamp + 2ms);
+  EXPECT_FALSE(loop.remove(tun.fd()));
+}
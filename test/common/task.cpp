@@ -0,0 +1,234 @@
+#include "task.hpp"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+class TaskTest : public testing::Test {
+protected:
+  EventLoop loop_;
+  int sockets_[2]{-1, -1};
+
+  void SetUp() override {
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets_), 0);
+    ASSERT_FALSE(set_nonblocking(sockets_[0]));
+    ASSERT_FALSE(set_nonblocking(sockets_[1]));
+  }
+
+  void TearDown() override {
+    ::close(sockets_[0]);
+    ::close(sockets_[1]);
+  }
+};
+
+static Task<int> add_later(EventLoop &loop, int a, int b) {
+  co_await loop.sleep_for(1ms);
+  co_return a + b;
+}
+
+static Task<> sum(EventLoop &loop, int &result) {
+  result = co_await add_later(loop, 1, 2);
+  result += co_await add_later(loop, result, 4);
+  loop.stop();
+}
+
+TEST_F(TaskTest, AwaitNestedTasks) {
+  int result{};
+  spawn(loop_, sum(loop_, result));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(result, 10);
+}
+
+static Task<> sleep_ordered(EventLoop &loop, std::chrono::milliseconds delay,
+                            int id, std::vector<int> &order) {
+  EXPECT_FALSE(co_await loop.sleep_for(delay));
+  order.push_back(id);
+  if (order.size() == 3) {
+    loop.stop();
+  }
+}
+
+TEST_F(TaskTest, SleepFiresInDeadlineOrder) {
+  std::vector<int> order{};
+  spawn(loop_, sleep_ordered(loop_, 30ms, 3, order));
+  spawn(loop_, sleep_ordered(loop_, 10ms, 1, order));
+  spawn(loop_, sleep_ordered(loop_, 20ms, 2, order));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(order, (std::vector<int>{1, 2, 3}));
+}
+
+static Task<> echo(EventLoop &loop, int fd, int rounds) {
+  for (int i{0}; i < rounds; ++i) {
+    EXPECT_FALSE(co_await loop.readable(fd));
+    std::array<std::byte, 16> buffer{};
+    ssize_t length{::read(fd, buffer.data(), buffer.size())};
+    EXPECT_GT(length, 0);
+    EXPECT_EQ(::write(fd, buffer.data(), length), length);
+  }
+  EXPECT_FALSE(loop.remove(fd));
+}
+
+static Task<> ping(EventLoop &loop, int fd, int rounds, int &received) {
+  for (int i{0}; i < rounds; ++i) {
+    EXPECT_EQ(::write(fd, &i, sizeof(i)), sizeof(i));
+    EXPECT_FALSE(co_await loop.readable(fd));
+    int reply{-1};
+    EXPECT_EQ(::read(fd, &reply, sizeof(reply)), sizeof(reply));
+    EXPECT_EQ(reply, i);
+    ++received;
+  }
+  EXPECT_FALSE(loop.remove(fd));
+  loop.stop();
+}
+
+TEST_F(TaskTest, ReadableRearmsAcrossAwaits) {
+  constexpr int rounds{100};
+  int received{};
+  spawn(loop_, echo(loop_, sockets_[1], rounds));
+  spawn(loop_, ping(loop_, sockets_[0], rounds, received));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(received, rounds);
+}
+
+static Task<> await_io(EventLoop &loop, int fd, uint32_t events,
+                       std::error_code &error, int &resumed) {
+  error = co_await (events == EPOLLIN ? loop.readable(fd) : loop.writable(fd));
+  ++resumed;
+}
+
+static Task<> unblock(EventLoop &loop, int peer, int &resumed) {
+  co_await loop.sleep_for(5ms);
+  const int message{1};
+  EXPECT_EQ(::write(peer, &message, sizeof(message)), sizeof(message));
+  std::array<std::byte, 4096> buffer{};
+  while (::read(peer, buffer.data(), buffer.size()) > 0) {
+  }
+  for (int i{0}; i < 100 && resumed < 2; ++i) {
+    co_await loop.sleep_for(1ms);
+  }
+  loop.stop();
+}
+
+TEST_F(TaskTest, ReaderAndWriterShareFd) {
+  const int message{0};
+  while (::write(sockets_[0], &message, sizeof(message)) > 0) {
+  }
+  ASSERT_EQ(errno, EAGAIN);
+
+  int resumed{};
+  std::error_code read_error{std::make_error_code(std::errc::io_error)};
+  std::error_code write_error{std::make_error_code(std::errc::io_error)};
+  spawn(loop_, await_io(loop_, sockets_[0], EPOLLIN, read_error, resumed));
+  spawn(loop_, await_io(loop_, sockets_[0], EPOLLOUT, write_error, resumed));
+  spawn(loop_, unblock(loop_, sockets_[1], resumed));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(resumed, 2);
+  EXPECT_FALSE(read_error) << read_error.message();
+  EXPECT_FALSE(write_error) << write_error.message();
+  EXPECT_FALSE(loop_.remove(sockets_[0]));
+}
+
+static Task<> write_later(EventLoop &loop, int peer) {
+  co_await loop.sleep_for(5ms);
+  const int message{1};
+  EXPECT_EQ(::write(peer, &message, sizeof(message)), sizeof(message));
+  co_await loop.sleep_for(5ms);
+  loop.stop();
+}
+
+TEST_F(TaskTest, SecondReaderIsBusy) {
+  int resumed{};
+  std::error_code first{std::make_error_code(std::errc::io_error)};
+  std::error_code second{};
+  spawn(loop_, await_io(loop_, sockets_[0], EPOLLIN, first, resumed));
+  spawn(loop_, await_io(loop_, sockets_[0], EPOLLIN, second, resumed));
+  spawn(loop_, write_later(loop_, sockets_[1]));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(resumed, 2);
+  EXPECT_FALSE(first) << first.message();
+  EXPECT_EQ(second, std::errc::device_or_resource_busy);
+  EXPECT_FALSE(loop_.remove(sockets_[0]));
+}
+
+static Task<> read_one(EventLoop &loop, int fd, int rounds, int &received) {
+  for (int i{0}; i < rounds; ++i) {
+    EXPECT_FALSE(co_await loop.readable(fd));
+    int message{-1};
+    EXPECT_EQ(::read(fd, &message, sizeof(message)), sizeof(message));
+    EXPECT_EQ(message, i);
+    ++received;
+  }
+  EXPECT_FALSE(loop.remove(fd));
+  loop.stop();
+}
+
+TEST_F(TaskTest, UndrainedFdWakesAgain) {
+  constexpr int rounds{3};
+  for (int i{0}; i < rounds; ++i) {
+    ASSERT_EQ(::write(sockets_[1], &i, sizeof(i)), sizeof(i));
+  }
+
+  int received{};
+  spawn(loop_, read_one(loop_, sockets_[0], rounds, received));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(received, rounds);
+}
+
+static Task<> wait_cancelled(EventLoop &loop, int fd, CancellationToken token,
+                             std::error_code &read_error,
+                             std::error_code &sleep_error) {
+  read_error = co_await loop.readable(fd, token);
+  sleep_error = co_await loop.sleep_for(1h, token);
+  loop.stop();
+}
+
+static Task<> cancel_after(EventLoop &loop, CancellationSource &source) {
+  co_await loop.sleep_for(5ms);
+  source.cancel();
+}
+
+TEST_F(TaskTest, CancelPendingRead) {
+  CancellationSource source{};
+  std::error_code read_error{};
+  std::error_code sleep_error{};
+  spawn(loop_, wait_cancelled(loop_, sockets_[0], source, read_error,
+                              sleep_error));
+  spawn(loop_, cancel_after(loop_, source));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(read_error, std::errc::operation_canceled);
+  EXPECT_EQ(sleep_error, std::errc::operation_canceled);
+}
+
+struct FrameAddress {
+  void *&address;
+
+  bool await_ready() noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle) noexcept {
+    address = handle.address();
+    return false;
+  }
+  void await_resume() noexcept {}
+};
+
+static Task<> record_frame(EventLoop &loop, void *&frame) {
+  co_await FrameAddress{frame};
+}
+
+static Task<> record_frame_later(EventLoop &loop, void *&frame) {
+  co_await record_frame(loop, frame);
+  loop.stop();
+}
+
+TEST_F(TaskTest, FramesAreRecycled) {
+  void *first{};
+  void *second{};
+  spawn(loop_, record_frame(loop_, first));
+  spawn(loop_, record_frame_later(loop_, second));
+  ASSERT_FALSE(loop_.start());
+  EXPECT_EQ(first, second);
+}
@@ -0,0 +1,225 @@
+#include "tun_steering.hpp"
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <netinet/in.h>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static auto ipv4(const char *host) -> Address {
+  sockaddr_in address{.sin_family = AF_INET};
+  EXPECT_EQ(::inet_pton(AF_INET, host, &address.sin_addr), 1);
+  Address result{};
+  std::memcpy(&result.storage, &address, sizeof(address));
+  result.length = sizeof(address);
+  return result;
+}
+
+static auto packet_to(const char *host) -> std::array<std::byte, 20> {
+  std::array<std::byte, 20> packet{};
+  packet[0] = std::byte{0x45};
+  in_addr destination{};
+  EXPECT_EQ(::inet_pton(AF_INET, host, &destination), 1);
+  std::memcpy(&packet[16], &destination, sizeof(destination));
+  return packet;
+}
+
+TEST(TunSteering, OwnerFollowsSteer) {
+  std::vector<TunDevice> queues(4);
+  TunSteering steering{queues};
+
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.2")), std::nullopt);
+  ASSERT_FALSE(steering.steer(ipv4("10.0.0.2"), 3));
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.2")), 3);
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.3")), std::nullopt);
+
+  ASSERT_FALSE(steering.steer(ipv4("10.0.0.2"), 1));
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.2")), 1);
+  ASSERT_FALSE(steering.unsteer(ipv4("10.0.0.2")));
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.2")), std::nullopt);
+}
+
+TEST(TunSteering, RejectsInvalidSteer) {
+  std::vector<TunDevice> queues(2);
+  TunSteering steering{queues};
+
+  EXPECT_EQ(steering.steer(ipv4("10.0.0.2"), 2), std::errc::invalid_argument);
+  EXPECT_EQ(steering.steer(Address{}, 0),
+            std::errc::address_family_not_supported);
+  EXPECT_EQ(steering.owner(std::array<std::byte, 4>{}), std::nullopt);
+}
+
+TEST(TunSteering, RejectsSteerBeyondCapacity) {
+  std::vector<TunDevice> queues(2);
+  TunSteering steering{queues, 2};
+
+  ASSERT_FALSE(steering.steer(ipv4("10.0.0.2"), 0));
+  ASSERT_FALSE(steering.steer(ipv4("10.0.0.3"), 1));
+  EXPECT_EQ(steering.steer(ipv4("10.0.0.4"), 1),
+            std::errc::no_space_on_device);
+  EXPECT_FALSE(steering.steer(ipv4("10.0.0.3"), 0));
+  ASSERT_FALSE(steering.unsteer(ipv4("10.0.0.2")));
+  EXPECT_FALSE(steering.steer(ipv4("10.0.0.4"), 1));
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.3")), 0);
+  EXPECT_EQ(steering.owner(packet_to("10.0.0.4")), 1);
+}
+
+TEST(TunSteering, OwnerStableWhileOthersChurn) {
+  std::vector<TunDevice> queues(4);
+  TunSteering steering{queues, 64};
+  ASSERT_FALSE(steering.steer(ipv4("10.0.0.1"), 2));
+
+  std::atomic<bool> done{false};
+  std::thread writer{[&] {
+    for (int round{0}; round < 2000; ++round) {
+      for (int host{2}; host < 50; ++host) {
+        const std::string address{"10.0." + std::to_string(round % 4) + "." +
+                                  std::to_string(host)};
+        EXPECT_FALSE(steering.steer(ipv4(address.c_str()), host % 4));
+      }
+      for (int host{2}; host < 50; ++host) {
+        const std::string address{"10.0." + std::to_string(round % 4) + "." +
+                                  std::to_string(host)};
+        EXPECT_FALSE(steering.unsteer(ipv4(address.c_str())));
+      }
+    }
+    done = true;
+  }};
+
+  const auto packet{packet_to("10.0.0.1")};
+  std::size_t lookups{0};
+  while (!done) {
+    ASSERT_EQ(steering.owner(packet), 2);
+    ++lookups;
+  }
+  writer.join();
+  EXPECT_GT(lookups, 0);
+}
+
+// Gives the device 10.213.0.1/24 and brings it up, so the kernel routes the
+// rest of that subnet into it.
+static auto bring_up(const char *name) -> std::error_code {
+  const int control{::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+  if (control == -1) {
+    return {errno, std::system_category()};
+  }
+
+  ifreq request{};
+  std::strncpy(static_cast<char *>(request.ifr_name), name, IFNAMSIZ - 1);
+  sockaddr_in address{.sin_family = AF_INET};
+  std::error_code error{};
+  const auto configure{[&](unsigned long command, const char *value) {
+    if (!error) {
+      ::inet_pton(AF_INET, value, &address.sin_addr);
+      std::memcpy(&request.ifr_addr, &address, sizeof(address));
+      if (::ioctl(control, command, &request) == -1) {
+        error = {errno, std::system_category()};
+      }
+    }
+  }};
+  configure(SIOCSIFADDR, "10.213.0.1");
+  configure(SIOCSIFNETMASK, "255.255.255.0");
+  if (!error) {
+    request.ifr_flags = IFF_UP;
+    if (::ioctl(control, SIOCSIFFLAGS, &request) == -1) {
+      error = {errno, std::system_category()};
+    }
+  }
+
+  ::close(control);
+  return error;
+}
+
+static void send_to(const char *host) {
+  const int sender{::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+  ASSERT_NE(sender, -1);
+  sockaddr_in address{.sin_family = AF_INET, .sin_port = htons(9)};
+  ASSERT_EQ(::inet_pton(AF_INET, host, &address.sin_addr), 1);
+  const char payload{'x'};
+  EXPECT_EQ(::sendto(sender, &payload, sizeof(payload), 0,
+                     reinterpret_cast<const sockaddr *>(&address),
+                     sizeof(address)),
+            sizeof(payload));
+  ::close(sender);
+}
+
+// Returns the queue the next IPv4 packet to host was read from. Anything else
+// the kernel sends into the device, such as IPv6 router solicitations, is
+// skipped.
+static auto queue_of(std::vector<TunDevice> &queues, const char *host)
+    -> std::optional<std::size_t> {
+  in_addr destination{};
+  EXPECT_EQ(::inet_pton(AF_INET, host, &destination), 1);
+
+  std::vector<pollfd> fds{};
+  for (const TunDevice &queue : queues) {
+    fds.push_back({.fd = queue.fd(), .events = POLLIN});
+  }
+  while (::poll(fds.data(), fds.size(), 1000) > 0) {
+    for (std::size_t index{0}; index < queues.size(); ++index) {
+      if ((fds[index].revents & POLLIN) == 0) {
+        continue;
+      }
+
+      auto packet{queues[index].read()};
+      if (packet && packet->size() >= 20 &&
+          (std::to_integer<uint8_t>((*packet)[0]) >> 4) == 4 &&
+          std::memcmp(&(*packet)[16], &destination, sizeof(destination)) ==
+              0) {
+        return index;
+      }
+    }
+  }
+
+  return std::nullopt;
+}
+
+TEST(TunSteering, Offload) {
+  auto queues{TunDevice::create_multiqueue("mousesteer", 2)};
+  if (!queues) {
+    GTEST_SKIP() << "no multiqueue TUN: " << queues.error().message();
+  }
+
+  {
+    TunSteering steering{*queues};
+    ASSERT_FALSE(steering.steer(ipv4("10.213.0.2"), 1));
+    std::error_code error{steering.offload()};
+    if (error) {
+      GTEST_SKIP() << "no eBPF steering: " << error.message();
+    }
+    EXPECT_TRUE(steering.offloaded());
+    ASSERT_FALSE(steering.steer(ipv4("10.213.0.3"), 0));
+    ASSERT_FALSE(bring_up("mousesteer"));
+
+    // Each destination is sent twice, so one landing on its queue by chance
+    // of the default spread is not enough to pass.
+    for (int round{0}; round < 2; ++round) {
+      send_to("10.213.0.2");
+      EXPECT_EQ(queue_of(*queues, "10.213.0.2"), 1);
+      send_to("10.213.0.3");
+      EXPECT_EQ(queue_of(*queues, "10.213.0.3"), 0);
+    }
+
+    // Moving a session moves its return traffic.
+    ASSERT_FALSE(steering.steer(ipv4("10.213.0.2"), 0));
+    ASSERT_FALSE(steering.steer(ipv4("10.213.0.3"), 1));
+    send_to("10.213.0.2");
+    EXPECT_EQ(queue_of(*queues, "10.213.0.2"), 0);
+    send_to("10.213.0.3");
+    EXPECT_EQ(queue_of(*queues, "10.213.0.3"), 1);
+    EXPECT_FALSE(steering.unsteer(ipv4("10.213.0.2")));
+  }
+
+  for (const TunDevice &queue : *queues) {
+    ::close(queue.fd());
+  }
+}